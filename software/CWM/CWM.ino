@@ -1,30 +1,33 @@
 #include "logger.hpp"
-#include "button.hpp"
 #include "stepper.hpp"
+#include "engine.hpp"
+#include "planner.hpp"
+#include "job.hpp"
+#include "program.hpp"
 #include "config.hpp"
 #include "automaton.hpp"
 #include "states.hpp"
+#include "input.hpp"
+#ifdef TELEMETRY
+#include "telemetry.hpp"
+#endif
 
 
 // Define the functions
-void homeAxis(StepperMotor&, Button&, long, double);
+void homeAxis(StepperMotor&, uint8_t, long, double);
 void home();
-void moveAll();
 void disable();
 void enable();
 
 // Automaton instance
-FiniteStateAutomaton fsm;
+FiniteStateAutomaton fsm(MenuTransitionTable::next);
 
-// Define the steppers
-StepperMotor stepperCoil(STEPPER_1_STEP_PIN, STEPPER_1_DIR_PIN);
-StepperMotor stepperFeeder(STEPPER_2_STEP_PIN, STEPPER_2_DIR_PIN);
+// Define the steppers (pins resolved at compile time)
+FastStepperMotor<STEPPER_1_STEP_PIN, STEPPER_1_DIR_PIN> stepperCoil;
+FastStepperMotor<STEPPER_2_STEP_PIN, STEPPER_2_DIR_PIN> stepperFeeder;
 
-// Define the buttons
-Button limitSwitch(LIMIT_SWITCH_PIN);
-Button upButton(UP_BUTTON_PIN);
-Button downButton(DOWN_BUTTON_PIN);
-Button selectButton(SELECT_BUTTON_PIN);
+// Motion planner, feeds the step engine
+Planner planner(stepEngine);
 
 // Variables
 /*
@@ -45,7 +48,34 @@ float time = 10;              // s
 float speed = 5000.0;         // steps/s
 bool direction = 0;
 
-int state = 0;            // 0 idle, 1 winding, 2 unwinding
+int state = 0;            // 0 idle, 1 winding, 2 unwinding, 3 pause/resume, 4 abort, 5 compile winding
+int progress = 0;         // % of the current job
+bool jobPaused = false;   // the current job is pausing or paused
+
+// States, statically allocated
+StateMenuSplashScreen stateMenuSplashScreen;
+
+StateWind stateWind;
+StateSetWireDiameter stateSetWireDiameter(wireDiameter);
+StateSetSpoolLength stateSetSpoolLength(spoolLength);
+StateSetSpoolDiameter stateSetSpoolDiameter(spoolDiameter);
+StateSetLayerCount stateSetLayerCount(layerCount);
+StateWindAskConfirm stateWindAskConfirm(state);
+StateStartWinding stateStartWinding(state, progress, jobPaused);
+
+StateUnwind stateUnwind;
+StateSetTime stateSetTime(time);
+StateSetSpeed stateSetSpeed(speed);
+StateSetDirection stateSetDirection(direction);
+StateUnwindAskConfirm stateUnwindAskConfirm;
+StateStartUnwinding stateStartUnwinding(state, progress, jobPaused);
+
+#ifdef TELEMETRY
+// Telemetry stream, velocities come from the position change between samples
+Telemetry telemetry;
+long telemetryPosition[2] = {0, 0};
+unsigned long telemetryTime = 0;   // us
+#endif
 
 /* ---------------------------------- Setup --------------------------------- */
 
@@ -60,39 +90,50 @@ void setup() {
   Logger::setLogLevel(Logger::DEBUG);
 
   // Setup the board
-  pinMode(ENABLE, OUTPUT);
+  FastPin<ENABLE>::setOutput();
   disable();
 
+  // Hand the steppers to the step engine
+  stepEngine.addAxis(&stepperCoil);
+  stepEngine.addAxis(&stepperFeeder);
+
   // Setup the LCD
   setupLCD();
 
-  // Create and add states
-  fsm.addState(new StateMenuSplashScreen(&fsm));
+  // Add the states
+  fsm.addState(&stateMenuSplashScreen);
 
-  fsm.addState(new StateWind(&fsm));
-  fsm.addState(new StateSetWireDiameter(&fsm, wireDiameter));
-  fsm.addState(new StateSetSpoolLength(&fsm, spoolLength));
-  fsm.addState(new StateSetSpoolDiameter(&fsm, spoolDiameter));
-  fsm.addState(new StateSetLayerCount(&fsm, layerCount));
-  fsm.addState(new StateWindAskConfirm(&fsm));
-  fsm.addState(new StateStartWinding(&fsm, state));
+  fsm.addState(&stateWind);
+  fsm.addState(&stateSetWireDiameter);
+  fsm.addState(&stateSetSpoolLength);
+  fsm.addState(&stateSetSpoolDiameter);
+  fsm.addState(&stateSetLayerCount);
+  fsm.addState(&stateWindAskConfirm);
+  fsm.addState(&stateStartWinding);
 
-  fsm.addState(new StateUnwind(&fsm));
-  fsm.addState(new StateSetTime(&fsm, time));
-  fsm.addState(new StateSetSpeed(&fsm, speed));
-  fsm.addState(new StateSetDirection(&fsm, direction));
-  fsm.addState(new StateUnwindAskConfirm(&fsm));
-  fsm.addState(new StateStartUnwinding(&fsm, state));
+  fsm.addState(&stateUnwind);
+  fsm.addState(&stateSetTime);
+  fsm.addState(&stateSetSpeed);
+  fsm.addState(&stateSetDirection);
+  fsm.addState(&stateUnwindAskConfirm);
+  fsm.addState(&stateStartUnwinding);
 
   // Start the automaton with the first menu item
   fsm.start(STATE_MENU_SPLASH_SCREEN);
 
+  // Inputs, debounced together, the pin change interrupt wakes the sampling up
+  input.add(UP_BUTTON_PIN, EVENT_UP_PRESS, true);
+  input.add(DOWN_BUTTON_PIN, EVENT_DOWN_PRESS, true);
+  input.add(SELECT_BUTTON_PIN, EVENT_SELECT_PRESS);
+  input.add(LIMIT_SWITCH_PIN, 0);
+  input.begin();
+
   // Enable the board
   enable();
 
   // Home axis
   home();
-  // Logger::debug("All axis homed"); 
+  // Logger::debug(F("All axis homed")); 
 
   // Temporary disable the board
   disable();
@@ -102,103 +143,127 @@ void setup() {
   fsm.onEvent(EVENT_TIMEOUT);
 }
 
-/* -------------------------------- Movement -------------------------------- */
+/* ---------------------------------- Jobs ---------------------------------- */
 
-void wind() {
+class UnwindJob : public Job {
+/**
+ * Unwinding, a single move of the coil.
+ */
 
-    /*
-    Logger::debug("Starting winding process");
-    Logger::debug("Wire diameter: {}", wireDiameter);
-    Logger::debug("Spool length: {}", spoolLength);
-    Logger::debug("Spool diameter: {}", spoolDiameter);
-    Logger::debug("Layer count: {}", layerCount);
-    */
+public:
+    uint16_t size() override {
+        return 1;
+    }
 
-    for (int layer = 0; layer < layerCount; ++layer) {
+    void move(uint16_t index, long& targetCoil, long& targetFeeder, double& velocity) override {
+        // speed = distance / time -> distance = speed * time
+        targetCoil = speed * time;
+        targetFeeder = 0;
+        velocity = speed;
+    }
+};
 
-        // Logger::debug("---------");
+SegmentProgram windProgram;
+ProgramJob windJob(windProgram);
 
-        // Current diameter of the spool at this layer
-        double currentDiameter = spoolDiameter + 2 * layer * wireDiameter;
-        // Logger::debug("Layer {}: Current diameter: {}", layer, currentDiameter);
+// Coil programs sent over Serial, compiled into the winding program
+CoilCompiler coilCompiler(windProgram);
+ProgramLoader programLoader(coilCompiler, spoolLength, spoolDiameter);
+UnwindJob unwindJob;
 
-        // Length of wire wound per full revolution of the spool motor
-        double wireWoundPerRev = PI * currentDiameter;
-        // Logger::debug("Layer {}: Wire wound per revolution: {} mm", layer, wireWoundPerRev);
+// Runs the jobs from loop(), the coil leads
+JobRunner runner(planner, stepEngine, stepperCoil, stepperFeeder);
+JobRunner::Status shownStatus = JobRunner::IDLE;    // last status the screen was told about
 
-        // Number of wire revolutions around the coil
-        double numRevolutions = spoolLength / wireDiameter;
-        // Logger::debug("Layer {}: Num revolutions: {}", layer, numRevolutions);
+/* -------------------------------- Movement -------------------------------- */
 
-        // Number of steps for the coil motor to perform all the revolutions
-        long totalCoilSteps = numRevolutions * STEPS_PER_REVOLUTION * MICROSTEPPING;
-        // Logger::debug("Layer {}: Total coil steps: {}", layer, totalCoilSteps);
+void compileWind() {
+    /**
+     * Turn the coil parameters into the winding program, while the user is
+     * asked to confirm, so that nothing is left to compute when it starts.
+     */
 
-        // Time the coil motor takes to perform a single revolution
-        double timeRevolution = (STEPS_PER_REVOLUTION * MICROSTEPPING) / WINDING_VELOCITY_STEPS_S;
-        // Logger::debug("Layer {}: Time to complete a revolution: {}", layer, timeRevolution);
+    // A program loaded over Serial takes the place of the menu parameters
+    if (programLoader.isReady()) {
+        Logger::debug(F("Winding the loaded program, {} segments"), (int)windProgram.size());
+        return;
+    }
+    programLoader.drop();
 
-        // The coil motor has a fixed velocity. We want the feeder to move by wireDiameter mm 
-        // for each full revolution of the coil motor. We know how many steps it takes to perform
-        // wireDiameter mm. We impose the same time as the time needed to the coil motor to perform
-        // a single revolution and we compute the feeder velocity from it. 
-        long feederVelocity = (STEPS_PER_MM * wireDiameter) / timeRevolution;
-        // Logger::debug("Layer {}: Feeder velocity: {}", layer, feederVelocity);
+    Logger::debug(F("Winding {} layers of {} mm wire"), (int)layerCount, wireDiameter);
+    Logger::debug(F("Spool: {} mm long, {} mm diameter"), spoolLength, spoolDiameter);
 
-        // Compute the total steps needed to the feeder
-        long totalFeederSteps = STEPS_PER_MM * spoolLength;
-        // Logger::debug("Layer {}: Feeder steps: {}", layer, totalFeederSteps);
+    if (!compileWinding(windProgram, wireDiameter, spoolLength, spoolDiameter, layerCount)) {
+        Logger::error(F("Winding program too long, {} segments at most"), (int)PROGRAM_SEGMENTS);
+        windProgram.clear();
+    }
+}
 
-        // Move both motors simultaneously for the current layer
-        stepperCoil.moveToPosition(totalCoilSteps, WINDING_VELOCITY_STEPS_S);
-        stepperFeeder.moveToPosition(-totalFeederSteps, feederVelocity);
+void wind() {
+    /**
+     * Start winding, loop() keeps the job going.
+     */
+
+    // Never from a program still being loaded, or a broken one
+    ProgramLoader::Status loading = programLoader.getStatus();
+    if (loading == ProgramLoader::LOADING || loading == ProgramLoader::FAILED) {
+        Logger::error(F("Program not loaded, winding refused"));
+        windProgram.clear();
+    }
 
-        moveAll();
+    if (windProgram.size() == 0) {
+        fsm.onEvent(EVENT_RESET);
+        disable();
+        return;
     }
 
-    // Logger::debug("Winding process complete");
+    windJob.begin(stepperCoil.getCurrentPosition(), stepperFeeder.getCurrentPosition());
+    runner.start(&windJob);
 }
 
 void unwind() {
+    /**
+     * Start unwinding, loop() keeps the job going.
+     */
 
-    /*
-    Logger::debug("Starting winding process");
-    Logger::debug("Time: {}", time);
-    Logger::debug("Speed: {}", speed);
-    Logger::debug("Direction: {}", direction ? "Forward" : "Backward");
-    */
-
-    Logger::debug("Time: {}", time);
-    Logger::debug("Speed: {}", speed);
-    Logger::debug("Direction: {}", direction ? "Forward" : "Backward");
-
-    // speed = distance / time -> distance = speed * time
-    int distance = speed * time;
-
-    stepperFeeder.moveToPosition(0, speed);
-    stepperCoil.moveToPosition(distance, speed);
-
-    moveAll();
-
-    Logger::debug("Unwinding process complete");
+    Logger::debug(F("Time: {}"), time);
+    Logger::debug(F("Speed: {}"), speed);
+    Logger::debug(F("Direction: {}"), direction ? F("Forward") : F("Backward"));
 
+    runner.start(&unwindJob);
 }
 
-void moveAll() {
+/* -------------------------------- Telemetry ------------------------------- */
+
+#ifdef TELEMETRY
+void sampleTelemetry() {
   /**
-   * Move all steppers until they reach the target position.
+   * Encode a telemetry sample of both motors and of the automaton.
    */
-  while (!(stepperCoil.isAtTarget() && stepperFeeder.isAtTarget())) {
-    stepperCoil.step();
-    stepperFeeder.step();
+
+  TelemetrySample sample;
+  unsigned long now = micros();
+  double elapsed = (now - telemetryTime) / 1e6;
+  long position[2] = { stepperCoil.getCurrentPosition(), stepperFeeder.getCurrentPosition() };
+
+  sample.time = now / 1000;
+  sample.state = fsm.getStateID();
+  for (uint8_t i = 0; i < 2; i++) {
+    sample.position[i] = position[i];
+    sample.velocity[i] = (position[i] - telemetryPosition[i]) / elapsed;
+    telemetryPosition[i] = position[i];
   }
+  telemetryTime = now;
+
+  telemetry.sample(sample);
 }
+#endif
 
 /* --------------------------------- Homing --------------------------------- */
 
 void homeAxis(
     StepperMotor& stepper, 
-    Button& limitSwitch, 
+    uint8_t limitSwitchPin, 
     long homingSteps, 
     double velocity
   ) {
@@ -211,19 +276,25 @@ void homeAxis(
    * to move safely to the target.
    */
 
+  Logger::debug(F("Homing, at most {} steps"), homingSteps);
+
+  // Forget the presses from before
+  input.trip(limitSwitchPin);
+
   stepper.moveToPosition(homingSteps, velocity);
-  while (!stepper.isAtTarget()) {
+  stepEngine.start();
+  while (stepEngine.isRunning()) {
+
+    Logger::drain();
+    lcdRenderer.flush();
 
-    if (limitSwitch.pressed()) {
-      Logger::debug("Endstop {} reached.", limitSwitch.getPin());
+    if (input.trip(limitSwitchPin)) {
+      stepEngine.stop();
+      Logger::debug(F("Endstop {} reached."), limitSwitchPin);
       break;
     }
 
-    // Perform a step with constant velocity
-    stepper.step();
-
-    // Little delay to smooth things out
-    delayMicroseconds(10);
+    yield();
   }
 
   // Set the zero
@@ -236,84 +307,156 @@ void home() {
    */
 
   // Move the first axis down for 10000 steps or until the limit switch registers a press
-  homeAxis(stepperFeeder, limitSwitch, MAX_HOMING_STEPS, HOMING_VELOCITY_STEPS_S);
-  // Logger::debug("Axis 0 homed.");
+  homeAxis(stepperFeeder, LIMIT_SWITCH_PIN, MAX_HOMING_STEPS, HOMING_VELOCITY_STEPS_S);
+  Logger::debug(F("Axis 0 homed."));
 
 }
 
 void enable() {
-  digitalWrite(ENABLE, LOW);
-  // Logger::debug("Steppers enabled.");
+  FastPin<ENABLE>::low();
+  Logger::debug(F("Steppers enabled."));
 }
 
 void disable() {
-  digitalWrite(ENABLE, HIGH);
-  // Logger::debug("Steppers disabled.");
+  FastPin<ENABLE>::high();
+  Logger::debug(F("Steppers disabled."));
 }
 
 /* ---------------------------------- Loop ---------------------------------- */
 
 void loop() {
 
-    if (upButton.pressed()) {
-        // logger.debug("Up button pressed");
-        fsm.onEvent(EVENT_UP_PRESS);
+    // Hand the queued log records to the serial port
+    Logger::drain();
+
+    // Send the next few changed cells to the display
+    lcdRenderer.flush();
+
+#ifdef TELEMETRY
+    if (telemetry.isDue()) {
+        sampleTelemetry();
     }
-    if (upButton.isHeld()) {
-        // logger.debug("Up button long pressed");
-        fsm.onEvent(EVENT_UP_LONGPRESS);
+    telemetry.send();
+#endif
+
+    // Sample the inputs if any of them moved, the presses are queued
+    input.update();
+    fsm.dispatch(input.events);
+
+    // Long presses: up and down repeat faster and faster while held, the
+    // ticks this pass was late for come as one event
+    uint8_t count;
+    if ((count = input.takeRepeats(UP_BUTTON_PIN)) != 0) {
+        fsm.onEvent(EVENT_UP_LONGPRESS, count);
     }
-    if (downButton.pressed()) {
-        // logger.debug("Down button pressed");
-        fsm.onEvent(EVENT_DOWN_PRESS);
+    if ((count = input.takeRepeats(DOWN_BUTTON_PIN)) != 0) {
+        fsm.onEvent(EVENT_DOWN_LONGPRESS, count);
     }
-    if (downButton.isHeld()) {
-        // logger.debug("Down button long pressed");
-        fsm.onEvent(EVENT_DOWN_LONGPRESS);
+    if (input.takeRepeats(SELECT_BUTTON_PIN) != 0) {
+        fsm.onEvent(EVENT_SELECT_LONGPRESS);
     }
-    if (selectButton.pressed()) {
-        // logger.debug("Select button pressed");
-        fsm.onEvent(EVENT_SELECT_PRESS);
+
+    // Coil programs, not while a job runs from the buffer they are compiled
+    // into, nor once it is confirmed (the bytes wait on the port till then)
+    uint8_t screen = fsm.getStateID();
+    bool loading = !runner.isBusy() && screen != STATE_WIND_ASK_CONFIRM && screen != STATE_START_WINDING;
+#ifdef STEP_JITTER
+    // Serial commands at the start of a line, at any time: 'j' dumps the step
+    // jitter histogram, 'r' clears it (line ends in between are empty program
+    // lines, nothing to the loader). Anything else is a program line
+    while (Serial.available()) {
+        char command = Serial.peek();
+        if (!programLoader.isInLine() && (command == 'j' || command == 'r' || command == '\r' || command == '\n')) {
+            Serial.read();
+            if (command == 'j') {
+                stepEngine.jitter.dump(Serial);
+            } else if (command == 'r') {
+                stepEngine.jitter.reset();
+            }
+        } else if (loading) {
+            programLoader.take(Serial.read());
+        } else {
+            break;
+        }
     }
-    if (selectButton.isHeld()) {
-        // logger.debug("Select button long pressed");
-        fsm.onEvent(EVENT_SELECT_LONGPRESS);
+#else
+    if (loading) {
+        programLoader.update();
     }
+#endif
 
     switch (state) {
         case 1:
 
             enable();
 
-            // Start the winding routine (blocking)
+            // Start the winding job
             wind();
-
-            // Done
-            fsm.onEvent(EVENT_RESET);
             state = 0;
 
-            // Disable the board
-            disable(); 
-
             break;
 
         case 2:
 
             enable();
 
-            // Start the unwinding routine (blocking)
+            // Start the unwinding job
             unwind();
+            state = 0;
 
-            // Done
-            fsm.onEvent(EVENT_RESET);
+            break;
+
+        case 3:
+
+            // Pause or resume the current job (also after a tap), the motors stay enabled to hold the position
+            if (runner.getStatus() == JobRunner::RUNNING) {
+                runner.pause();
+            } else {
+                runner.resume();
+            }
             state = 0;
 
-            // Disable the board
-            disable();
+            break;
+
+        case 4:
+
+            // Abort the current job
+            runner.abort();
+            state = 0;
+
+            break;
+
+        case 5:
+
+            // Prepare the winding job while the user confirms
+            compileWind();
+            state = 0;
 
             break;
 
         default:
             break;
     }
+
+    // Keep the current job going, the screen follows the job status (a pause only takes effect once the motors are at rest)
+    bool changed = runner.update();
+    JobRunner::Status status = runner.getStatus();
+    jobPaused = status == JobRunner::PAUSING || status == JobRunner::PAUSED;
+    if (changed || status != shownStatus) {
+        shownStatus = status;
+        progress = runner.getProgress();
+        fsm.onEvent(status == JobRunner::HELD ? EVENT_TAP : EVENT_UPDATE_PROGRESS);
+    }
+
+    if (runner.isOver()) {
+        Logger::debug(runner.getStatus() == JobRunner::DONE ? F("Job complete") : F("Job aborted"));
+        runner.clear();
+        progress = 0;
+
+        // Done
+        fsm.onEvent(EVENT_RESET);
+
+        // Disable the board
+        disable();
+    }
 }
@@ -3,118 +3,157 @@
 
 #include <Arduino.h>
 
-class FiniteStateAutomaton; // Forward declaration
+#include "config.hpp"
+#include "indices.hpp"
+#include "ring_buffer.hpp"
 
 class State {
 public:
     uint8_t id;
-    FiniteStateAutomaton* automaton;  // Pointer to the automaton
 
-    State(uint8_t id, FiniteStateAutomaton* automaton);
+    State(uint8_t id);
     virtual ~State();
 
     // Method called when entering the state
     virtual void onEnter();
 
-    // Method to handle events
-    virtual State* onEvent(const uint8_t& event);
+    // Method to handle the events that don't change the state, count > 1 when
+    // several repeats of a held key have been merged into one event
+    virtual void onEvent(const uint8_t& event, uint8_t count);
 };
 
+/* ------------------------------- Transitions ------------------------------ */
+
+// A state change: in state, on event, go to next
+struct Transition {
+    uint8_t state;
+    uint8_t event;
+    uint8_t next;
+};
+
+const uint8_t NO_TRANSITION = 0xFF;
+
+// Target of the transition for a state and an event, looked up at compile time
+constexpr uint8_t findTransition(const Transition* transitions, uint8_t count, uint8_t state, uint8_t event) {
+    return count == 0 ? NO_TRANSITION :
+        (transitions->state == state && transitions->event == event) ? transitions->next :
+        findTransition(transitions + 1, count - 1, state, event);
+}
+
+/**
+ * Dense transition table, one entry per state and event (next state or
+ * NO_TRANSITION), generated at compile time from a constexpr list of
+ * Transition and stored in flash. TRANSITIONS must have static storage:
+ *
+ *   constexpr Transition MENU[] = { {STATE_A, EVENT_X, STATE_B}, ... };
+ *   typedef TransitionTable<MENU, sizeof(MENU) / sizeof(Transition)> MenuTable;
+ */
+
+template<const Transition* TRANSITIONS, uint8_t COUNT, typename List = typename MakeIndices<STATE_COUNT * EVENT_COUNT>::type>
+struct TransitionTable;
+
+template<const Transition* TRANSITIONS, uint8_t COUNT, uint16_t... I>
+struct TransitionTable<TRANSITIONS, COUNT, Indices<I...>> {
+    static constexpr uint8_t next[sizeof...(I)] PROGMEM = {
+        findTransition(TRANSITIONS, COUNT, I / EVENT_COUNT, EVENT_FIRST + I % EVENT_COUNT)...
+    };
+};
+
+template<const Transition* TRANSITIONS, uint8_t COUNT, uint16_t... I>
+constexpr uint8_t TransitionTable<TRANSITIONS, COUNT, Indices<I...>>::next[sizeof...(I)];
+
+/* -------------------------------- Automaton ------------------------------- */
+
+// Events posted from loop() by the input handling (single producer), drained by FiniteStateAutomaton::dispatch
+typedef RingBuffer<uint8_t, EVENT_QUEUE_SIZE> EventQueue;
+
 // Finite State Automaton class
 class FiniteStateAutomaton {
-public:
-    FiniteStateAutomaton() : currentState(0), stateCount(0) {}
+/**
+ * States are indexed by their STATE_* id and the state changes come from a
+ * TransitionTable, so both finding a state and dispatching an event are a
+ * single lookup. Events without a transition are handed to the current
+ * state (e.g. to change the value it edits). The states are not owned,
+ * they are expected to be statically allocated.
+ */
 
-    ~FiniteStateAutomaton() {
-        for (int i = 0; i < stateCount; i++) {
-            delete states[i];
+public:
+    FiniteStateAutomaton(const uint8_t* _transitions) : transitions(_transitions), currentState(nullptr) {
+        for (uint8_t i = 0; i < STATE_COUNT; i++) {
+            states[i] = nullptr;
         }
     }
 
     // Add a state to the automaton
     void addState(State* state) {
-        if (stateCount < maxStates) { // Ensure we don't exceed the array size
-            states[stateCount++] = state;
-        } 
-        /*
-        else {
-            // Handle the case when too many states are added
-            // Serial.println("Error: Maximum number of states reached: " + String(stateCount) + "/" + String(maxStates));
+        if (state->id < STATE_COUNT) {
+            states[state->id] = state;
         }
-        */
     }
 
     // Start the automaton on the provided state
     void start(const uint8_t& stateID) {
-        State* state = findStateByID(stateID);
-        if (state != nullptr) {
-            currentState = state;
-            currentState->onEnter();
-        } 
-        /* else {
-            Serial.println("Error: State '" + String(stateID) + "' does not exist.");
-        }
-        */
+        changeState(stateID);
     }
 
     // Change the current state
     State* changeState(const uint8_t& stateID) {
-        State* state = findStateByID(stateID);
+        State* state = (stateID < STATE_COUNT) ? states[stateID] : nullptr;
         if (state != nullptr) {
             currentState = state;
             currentState->onEnter();
-        } 
-        /*
-        else {
-            Serial.println("Error: State '" + String(stateID) + "' does not exist.");
         }
-        */
         return state;
     }
 
     // Handle events
-    void onEvent(const uint8_t& event) {
+    void onEvent(const uint8_t& event, uint8_t count = 1) {
         if (currentState == nullptr) {
-            // Serial.println("Error: Automaton has not been initialized yet.");
             return;
         }
-        State* newState = currentState->onEvent(event);
-        if (newState != nullptr && newState != currentState) {
-            currentState = newState;
-            currentState->onEnter();
-        }
-    }
 
-private:
+        uint8_t next = NO_TRANSITION;
+        if (event >= EVENT_FIRST && event < EVENT_FIRST + EVENT_COUNT) {
+            next = pgm_read_byte(&transitions[currentState->id * EVENT_COUNT + event - EVENT_FIRST]);
+        }
 
-    State* states[20]; // Array to store up to 20 states
-    uint8_t maxStates = 20; // Maximum number of states we can add
-    uint8_t stateCount = 0; // Number of added states
-    State* currentState;
+        if (next != NO_TRANSITION) {
+            changeState(next);
+        } else {
+            currentState->onEvent(event, count);
+        }
+    }
 
-    // Helper function to find a state by ID
-    State* findStateByID(const uint8_t& stateID) {
-        for (int i = 0; i < stateCount; i++) {
-            if (states[i]->id == stateID) {
-                return states[i];
-            }
+    // Handle the queued events, call it from loop()
+    void dispatch(EventQueue& queue) {
+        uint8_t* event;
+        while ((event = queue.peek()) != nullptr) {
+            uint8_t value = *event;
+            queue.pop();
+            onEvent(value);
         }
-        return nullptr;
     }
+
+    // Id of the current state, 0xFF if the automaton has not been started
+    uint8_t getStateID() {
+        return currentState != nullptr ? currentState->id : 0xFF;
+    }
+
+private:
+    const uint8_t* transitions;     // TransitionTable::next, in flash
+    State* states[STATE_COUNT];
+    State* currentState;
 };
 
 // Implementation of State methods
-State::State(uint8_t id, FiniteStateAutomaton* automaton) {
+State::State(uint8_t id) {
     this->id = id;
-    this->automaton = automaton;
 }
 
 State::~State() {}
 
 void State::onEnter(void) {}
 
-State* State::onEvent(const uint8_t& event) {
-    return this;
-}
+void State::onEvent(const uint8_t& event, uint8_t count) {}
 
 #endif  // AUTOMATON_HPP
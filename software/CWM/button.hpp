@@ -3,70 +3,158 @@
 
 #include <Arduino.h>
 
-#define PRESSED LOW
-#define RELEASED HIGH
+#include "config.hpp"
+
+class ButtonBank {
+/**
+ * Debounces up to 8 inputs of the same port at once. Each sample is the
+ * whole port (one bit per input, 1 = pressed) and every input has a 2 bit
+ * counter, stored bit-sliced across two bytes (vertical counters): the
+ * counters of all the inputs are updated together with a handful of byte
+ * operations, and an input only changes state once its new level has been
+ * seen on 4 samples in a row.
+ *
+ * Edges are collected as bitmasks until they are taken, so nothing is lost
+ * between two reads:
+ *
+ *   bank.sample(~PINB & mask);
+ *   uint8_t pressed = bank.takePressed();
+ */
 
-class Button {
 public:
-    Button(uint8_t pin, uint16_t debounce_ms = 50)
-        : _pin(pin), _delay(debounce_ms), _state(RELEASED),
-          _ignore_until(0), _pressed_time(0), _has_changed(false) {
-        pinMode(_pin, INPUT_PULLUP);
+    ButtonBank() : state(0), count0(0xFF), count1(0xFF), pressed(0), held(0) {
+        memset(holdTicks, 0, sizeof(holdTicks));
     }
 
-    uint8_t getPin() {
-        return _pin; 
-    }
+    // Feed a sample of the inputs, every BUTTON_SAMPLE_MS
+    void sample(uint8_t levels) {
+        uint8_t changed = levels ^ state;
 
-    bool read() {
-        if (_ignore_until > millis()) {
-            // Ignore any changes until debounce period has passed
-        }
-        else if (digitalRead(_pin) != _state) {
-            _ignore_until = millis() + _delay;
-            _state = !_state;
-            _has_changed = true;
+        // Count down the inputs whose level differs from their state, reset the others
+        count0 = ~(count0 & changed);
+        count1 = count0 ^ (count1 & changed);
 
-            if (_state == PRESSED) {
-                _pressed_time = millis();  // Start timing when button is pressed
+        // Inputs whose counter rolled over take the new level
+        changed &= count0 & count1;
+        state ^= changed;
+        pressed |= state & changed;
+
+        // Time the inputs that are down, in samples
+        held = 0;
+        for (uint8_t i = 0; i < 8; i++) {
+            if (!(state & _BV(i))) {
+                holdTicks[i] = 0;
+            } else if (holdTicks[i] < HOLD_TICKS) {
+                holdTicks[i]++;
             } else {
-                _pressed_time = 0;  // Reset pressed time when button is released
+                held |= _BV(i);
             }
         }
+    }
 
-        return _state;
+    // Debounced state of the inputs
+    uint8_t getState() {
+        return state;
     }
 
-    bool hasChanged() {
-        if (_has_changed) {
-            _has_changed = false;
-            return true;
-        }
-        return false;
+    // Inputs down for at least LONG_PRESS_MS
+    uint8_t getHeld() {
+        return held;
     }
 
-    bool pressed() {
-        return (read() == PRESSED && hasChanged());
+    // Inputs pressed since the last call
+    uint8_t takePressed() {
+        uint8_t value = pressed;
+        pressed = 0;
+        return value;
+    }
+
+    // Check if nothing is counting, i.e. the state matches the last sample
+    bool isSettled() {
+        return (count0 & count1) == 0xFF;
+    }
+
+private:
+    static const uint8_t HOLD_TICKS = LONG_PRESS_MS / BUTTON_SAMPLE_MS;
+
+    uint8_t state;                  // debounced, 1 = pressed
+    uint8_t count0, count1;         // vertical counters, bit i of both is the counter of input i
+    uint8_t pressed;                // presses not taken yet
+    uint8_t held;                   // down for at least HOLD_TICKS
+    uint8_t holdTicks[8];           // samples each input has been down for
+};
+
+class KeyRepeat {
+/**
+ * Auto-repeat for held keys. A key that becomes held (see ButtonBank) ticks
+ * once, then every REPEAT_INTERVAL_MS, and every interval is a fraction
+ * REPEAT_ACCELERATION/100 of the one before, down to REPEAT_MIN_INTERVAL_MS,
+ * so values run faster the longer the key is held. Keys that are not set
+ * to repeat only tick once.
+ *
+ * Ticks that fall due between two updates are merged and counted, so a
+ * slow loop() applies them all at once instead of losing them or having
+ * each one trigger its own redraw.
+ */
+
+public:
+    KeyRepeat() : repeating(0), active(0) {
+        memset(counts, 0, sizeof(counts));
     }
 
-    bool released() {
-        return (read() == RELEASED && hasChanged());
+    // Keys that repeat while held
+    void setRepeating(uint8_t keys) {
+        repeating = keys;
     }
 
-    bool isHeld(uint16_t hold_time_ms = 800) {
-        if (_state == PRESSED && (millis() - _pressed_time >= hold_time_ms)) {
-            return true;
+    // Update with the held keys, returns the keys with ticks due
+    uint8_t update(uint8_t held, unsigned long now) {
+        uint8_t started = held & ~active;
+        uint8_t due = 0;
+        active = held;
+
+        for (uint8_t i = 0; held != 0; i++, held >>= 1) {
+            uint8_t bit = _BV(i);
+            if (!(held & 1)) {
+                continue;
+            }
+            if (started & bit) {
+                next[i] = now;
+                interval[i] = REPEAT_INTERVAL_MS;
+            } else if (!(repeating & bit)) {
+                continue;
+            }
+
+            while ((long)(now - next[i]) >= 0) {
+                if (counts[i] < 0xFF) {
+                    counts[i]++;
+                }
+                next[i] += interval[i];
+                interval[i] = max((uint16_t)((uint32_t)interval[i] * REPEAT_ACCELERATION / 100), REPEAT_MIN_INTERVAL_MS);
+                if (!(repeating & bit)) {
+                    break;
+                }
+            }
+            if (counts[i] != 0) {
+                due |= bit;
+            }
         }
-        return false;
+        return due;
+    }
+
+    // Ticks of a key (bit index) since the last call
+    uint8_t take(uint8_t key) {
+        uint8_t count = counts[key];
+        counts[key] = 0;
+        return count;
     }
 
 private:
-    uint8_t _pin;
-    uint16_t _delay;
-    uint8_t _state;
-    unsigned long _ignore_until;
-    unsigned long _pressed_time;
-    bool _has_changed;
+    uint8_t repeating;              // keys that repeat, the others tick once
+    uint8_t active;                 // keys held at the last update
+    unsigned long next[8];          // ms, next tick of each key
+    uint16_t interval[8];           // ms
+    uint8_t counts[8];              // ticks not taken yet
 };
 
 #endif // BUTTON_H
@@ -11,9 +11,47 @@ const byte STEPPER_2_DIR_PIN = 6;
 const byte ENABLE = 8;  // active-low (i.e. LOW turns on the drivers)
 
 // Velocity and acceleration
-const double MAX_VELOCITY_STEPS_S = 10000.0;
-const double MIN_VELOCITY_STEPS_S = 500.0;
-const double ACCELERATION = 5000.0;
+constexpr double MAX_VELOCITY_STEPS_S = 10000.0;
+constexpr double MIN_VELOCITY_STEPS_S = 500.0;
+constexpr double ACCELERATION = 5000.0;
+constexpr double JERK = 50000.0;                                             // steps/s^3, S-curve profile
+
+// Acceleration ramp table, one entry every 2^RAMP_TABLE_SHIFT steps
+const uint8_t RAMP_TABLE_SHIFT = 4;
+
+// Step engine (Timer1 with /8 prescaler)
+const uint32_t STEP_TIMER_FREQUENCY = 2000000;                               // ticks/s
+const uint8_t STEP_TIMER_TICKS_PER_US = STEP_TIMER_FREQUENCY / 1000000;
+const uint16_t MIN_STEP_TIMER_TICKS = 40;                                    // shortest ISR period, 20 us
+
+// Step timing instrumentation, uncomment to record how late the pulses land (see jitter.hpp)
+// #define STEP_JITTER
+const uint8_t STEP_JITTER_BINS = 16;
+const uint8_t STEP_JITTER_BIN_SHIFT = 3;                                     // bin width, 2^3 ticks = 4 us
+
+// Motion planner
+const uint8_t SEGMENT_QUEUE_SIZE = 4;                                        // power of two
+const uint8_t PLANNER_LOOKAHEAD = 8;                                         // segments
+constexpr double JUNCTION_JERK_STEPS_S = MIN_VELOCITY_STEPS_S;               // max instant velocity change per axis
+
+// LCD
+const uint8_t LCD_COLS = 16;
+const uint8_t LCD_ROWS = 2;
+const uint8_t LCD_BYTES_PER_FLUSH = 4;                                       // sent to the display per loop() iteration, ~1 ms of I2C
+
+// Logging
+const uint8_t LOG_MAX_LEVEL = 3;                                             // 0 INFO, 1 WARN, 2 ERROR, 3 DEBUG, calls above are compiled out
+const uint8_t LOG_LINE_SIZE = 64;                                            // longest record, longer ones are cut
+const uint8_t LOG_BUFFER_SIZE = 128;                                         // power of two, bytes waiting for the serial port
+
+// Binary telemetry over Serial, uncomment to stream position, velocity and state (see telemetry.hpp)
+// #define TELEMETRY
+const unsigned long TELEMETRY_PERIOD_MS = 20;                                // one frame every 20 ms
+
+// Jobs
+const unsigned long PROGRESS_UPDATE_MS = 250;                                // shortest time between two progress events
+const uint8_t PROGRAM_SEGMENTS = 24;                                         // moves of a compiled program
+const uint8_t PROGRAM_LINE_SIZE = 32;                                        // longest line of a program sent over Serial
 
 // Homing
 const double HOMING_VELOCITY_STEPS_S = 5000.0;
@@ -30,6 +68,14 @@ const uint8_t UP_BUTTON_PIN = 12;
 const uint8_t DOWN_BUTTON_PIN = 11;
 const uint8_t SELECT_BUTTON_PIN = 13;
 
+// Inputs, debounced over 4 samples (see button.hpp and input.hpp)
+const uint8_t BUTTON_SAMPLE_MS = 5;
+const uint16_t LONG_PRESS_MS = 800;
+const uint16_t REPEAT_INTERVAL_MS = 300;                                     // first auto-repeat interval
+const uint16_t REPEAT_MIN_INTERVAL_MS = 50;
+const uint8_t REPEAT_ACCELERATION = 80;                                      // % of the previous interval
+const uint8_t EVENT_QUEUE_SIZE = 8;                                          // power of two
+
 // Reduction ratios
 const int MICROSTEPPING = 8;
 const float STEPS_PER_REVOLUTION = 200.0;
@@ -94,5 +140,10 @@ const uint8_t EVENT_SELECT_PRESS = 26;
 const uint8_t EVENT_SELECT_LONGPRESS = 27;
 const uint8_t EVENT_UPDATE_PROGRESS = 28;
 const uint8_t EVENT_RESET = 29;
+const uint8_t EVENT_TAP = 30;
+
+const uint8_t STATE_COUNT = 15;                                              // ids 0 to 14
+const uint8_t EVENT_FIRST = EVENT_TIMEOUT;
+const uint8_t EVENT_COUNT = 10;                                              // ids 21 to 30
 
 #endif // CONFIG_HPP
\ No newline at end of file
@@ -0,0 +1,411 @@
+#ifndef STEP_ENGINE_HPP
+#define STEP_ENGINE_HPP
+
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "stepper.hpp"
+#include "ring_buffer.hpp"
+#include "jitter.hpp"
+
+/* ------------------------------- Step timer ------------------------------- */
+
+/**
+ * Timer1 in CTC mode, one compare match per scheduled event. The period is
+ * applied from inside the ISR, when the counter is already running: if the
+ * requested period is shorter than what elapsed so far it is stretched,
+ * otherwise the counter would miss the match and wrap around. Host builds 
+ * run the same code against the Timer1 emulation of the HAL.
+ */
+
+void stepTimerStart(uint16_t ticks) {
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    OCR1A = ticks - 1;
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 |= _BV(OCIE1A);
+    TCCR1B = _BV(WGM12) | _BV(CS11);
+}
+
+uint16_t stepTimerSetPeriod(uint16_t ticks) {
+    uint16_t elapsed = TCNT1 + MIN_STEP_TIMER_TICKS / 2;
+    if (ticks < elapsed) {
+        ticks = elapsed;
+    }
+    OCR1A = ticks - 1;
+    return ticks;
+}
+
+void stepTimerStop() {
+    TIMSK1 &= ~_BV(OCIE1A);
+    TCCR1B = 0;
+}
+
+/* ------------------------------- Step engine ------------------------------ */
+
+class StepEngine {
+/**
+ * Generates the step pulses of all the attached motors from a single hardware
+ * timer. Each axis keeps the number of ticks left before its next pulse: the
+ * timer is always programmed to expire on the closest deadline, all the axes
+ * that are due are stepped and their next deadline is taken from the motor.
+ * Whatever the timer overshoots is carried into the next interval, so the 
+ * pulses land on their deadlines on average and never drift.
+ *
+ * Two motors can also be driven along a line: only the one with more steps
+ * (the master) is scheduled, the other one is stepped from the master pulses
+ * with Bresenham's algorithm. Both land on their targets on the same pulse.
+ *
+ * All the axes due on the same tick share a single pulse: step pins on the
+ * same port are raised and lowered with one register write each (on the 
+ * CNC shield both step pins sit on PORTD) and the pulse width is paid once.
+ *
+ * Finally, linear segments can be streamed through a lock-free queue (see 
+ * Planner): when a segment ends the next one is loaded from the ISR on the 
+ * same pulse, so consecutive segments run without stopping in between.
+ */
+
+public:
+    static const uint8_t MAX_AXES = 2;
+
+    // Linear move ready to be executed from the ISR
+    struct Segment {
+        long steps[MAX_AXES];           // relative steps of each axis
+        RampSpeedProfile profile;       // already computed for the axis with more steps
+        unsigned long firstInterval;    // us before the first step
+    };
+
+    RingBuffer<Segment, SEGMENT_QUEUE_SIZE> queue;
+
+#ifdef STEP_JITTER
+    StepJitter<MAX_AXES> jitter;
+#endif
+
+    StepEngine() : axisCount(0), activeMask(0), period(0), master(nullptr), masterMask(0), slaveMask(0), streaming(false), braking(false) {}
+
+    // Attach a motor to the engine
+    void addAxis(StepperMotor* stepper) {
+        if (axisCount < MAX_AXES) {
+            stepPorts[axisCount] = stepper->stepPort();
+            stepMasks[axisCount] = stepper->stepMask();
+            axes[axisCount++] = stepper;
+        }
+    }
+
+    // Start all the attached motors that are not at their target yet
+    void start() {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            activeMask = 0;
+            masterMask = 0;
+            slaveMask = 0;
+            streaming = false;
+            braking = false;
+            for (uint8_t i = 0; i < axisCount; i++) {
+                if (!axes[i]->isAtTarget()) {
+                    remaining[i] = toTicks(axes[i]->getStepInterval());
+                    activeMask |= _BV(i);
+                }
+            }
+            if (activeMask) {
+                period = nextPeriod();
+                stepTimerStart(period);
+            }
+        }
+    }
+
+    // Start executing the queued segments, unless the engine is already busy
+    void startStream() {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (!activeMask) {
+                streaming = true;
+                braking = false;
+                if (loadSegment(0)) {
+                    period = nextPeriod();
+                    stepTimerStart(period);
+                } else {
+                    streaming = false;
+                }
+            }
+        }
+    }
+
+    /**
+     * Bring a linear move or the stream to rest instead of stopping dead: the
+     * queue is dropped and the running segment is cut short, so that its 
+     * master decelerates from where it is down to finalVelocity, the slave
+     * still following along the same line. Only as many steps as the segment
+     * has left are taken, past its end the direction could change. Without a
+     * master (start()) or already slow enough, this is stop(). A brake
+     * already under way is left to finish.
+     *
+     * The move is read in one short atomic section and the deceleration is
+     * installed in another: the profile is computed in between, with the
+     * interrupts on, while the master keeps stepping at its last interval.
+     */
+    void brake(double acceleration, double finalVelocity) {
+        unsigned long interval = 0;
+        long left = 0, lineMaster = 0, lineSlave = 0;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            streaming = false;
+            queue.clear();
+            if (braking && activeMask) {
+                return;
+            }
+            if (activeMask & masterMask) {
+                interval = master->getStepInterval();
+                left = abs(master->getTargetPosition() - master->getCurrentPosition());
+                lineMaster = masterSteps;
+                lineSlave = slaveMask ? slaveSteps : 0;
+            }
+        }
+
+        double velocity = (interval > 0) ? 1e6 / interval : 0;
+        long steps = (velocity > finalVelocity) ? min((long)((velocity * velocity - finalVelocity * finalVelocity) / (2 * acceleration)), left) : 0;
+        if (steps == 0) {
+            stop();
+            return;
+        }
+        double exitVelocity = sqrt(max(velocity * velocity - 2 * acceleration * steps, finalVelocity * finalVelocity));
+        brakeProfile.compute(steps, velocity, exitVelocity, velocity, acceleration);
+        long follow = lineMaster ? (long)((double)steps * lineSlave / lineMaster + 0.5) : 0;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            // The segment may have ended meanwhile, nothing left to brake
+            if (!(activeMask & masterMask)) {
+                return;
+            }
+
+            // The next pulse is already scheduled, only what comes after it changes
+            long position = master->getCurrentPosition();
+            long sign = (master->getTargetPosition() > position) ? 1 : -1;
+            steps = min(steps, abs(master->getTargetPosition() - position));
+            master->moveWithProfile(position + sign * steps, &brakeProfile, master->getStepInterval());
+            braking = true;
+
+            // Same line for the slave, Bresenham starts over on the shorter move
+            for (uint8_t i = 0; i < axisCount; i++) {
+                if (slaveMask & _BV(i)) {
+                    long slavePosition = axes[i]->getCurrentPosition();
+                    long slaveLeft = axes[i]->getTargetPosition() - slavePosition;
+                    follow = min(follow, abs(slaveLeft));
+                    axes[i]->followTo(slavePosition + (slaveLeft > 0 ? follow : -follow));
+                    if (follow == 0) {
+                        slaveMask = 0;
+                    }
+                }
+            }
+            masterSteps = steps;
+            slaveSteps = slaveMask ? follow : 0;
+            error = masterSteps / 2;
+        }
+    }
+
+    // Stop immediately, the motors keep the position they reached and the queue is dropped (emergencies, see brake())
+    void stop() {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            stepTimerStop();
+            for (uint8_t i = 0; i < axisCount; i++) {
+                if ((activeMask | slaveMask) & _BV(i)) {
+                    axes[i]->stop();
+                }
+            }
+            activeMask = 0;
+            slaveMask = 0;
+            streaming = false;
+            braking = false;
+            queue.clear();
+        }
+    }
+
+    bool isRunning() {
+        return activeMask != 0;
+    }
+
+    // Timer compare match handler
+    void onCompare() {
+#ifdef STEP_JITTER
+        // Ticks since the compare match, the counter restarted from zero there
+        uint16_t latency = TCNT1;
+#endif
+        uint8_t due = 0;
+
+        for (uint8_t i = 0; i < axisCount; i++) {
+            if (activeMask & _BV(i)) {
+                remaining[i] -= period;
+                if (remaining[i] <= 0) {
+                    due |= _BV(i);
+#ifdef STEP_JITTER
+                    jitter.record(i, latency - remaining[i]);
+#endif
+                }
+            }
+        }
+
+        // Bresenham: the slave follows the master along the line
+        if (due & masterMask) {
+            error -= slaveSteps;
+            if (error < 0) {
+                error += masterSteps;
+                due |= slaveMask;
+            }
+        }
+
+        pulse(due);
+
+        for (uint8_t i = 0; i < axisCount; i++) {
+            if (due & _BV(i)) {
+                unsigned long interval = axes[i]->advance();
+                if (slaveMask & _BV(i)) {
+                    continue;
+                }
+                if (interval == 0) {
+                    activeMask &= ~_BV(i);
+                } else {
+                    remaining[i] += toTicks(interval);
+                }
+            }
+        }
+
+        // Chain the next segment on the pulse that ended the current one
+        if (!activeMask && streaming) {
+            uint8_t m = indexOf(master);
+            queue.pop();
+            if (!loadSegment(remaining[m])) {
+                streaming = false;
+            }
+        }
+
+        if (activeMask) {
+            period = stepTimerSetPeriod(nextPeriod());
+        } else {
+            slaveMask = 0;
+            stepTimerStop();
+        }
+    }
+
+private:
+    StepperMotor* axes[MAX_AXES];
+    uint8_t axisCount;
+    volatile uint8_t* stepPorts[MAX_AXES];  // nullptr when the pin is only reachable through the motor
+    uint8_t stepMasks[MAX_AXES];
+    volatile uint8_t activeMask;
+    long remaining[MAX_AXES];   // ticks before the next pulse of each axis
+    uint16_t period;            // ticks of the period the timer is running
+
+    // Linear moves
+    StepperMotor* master;
+    uint8_t masterMask;
+    volatile uint8_t slaveMask;
+    long masterSteps, slaveSteps, error;
+
+    // Segment streaming
+    volatile bool streaming;
+    bool braking;                       // the master runs on brakeProfile
+
+    RampSpeedProfile brakeProfile;      // deceleration of brake(), the cut segment is gone from the queue
+
+    // Emit one pulse on all the due axes at the same time
+    void pulse(uint8_t due) {
+        volatile uint8_t* port = nullptr;
+        uint8_t bits = 0;
+        uint8_t others = 0;
+
+        // Gather the pins on the port of the first due axis, the rest goes one by one
+        for (uint8_t i = 0; i < axisCount; i++) {
+            if (due & _BV(i)) {
+                if (stepPorts[i] != nullptr && (port == nullptr || port == stepPorts[i])) {
+                    port = stepPorts[i];
+                    bits |= stepMasks[i];
+                } else {
+                    others |= _BV(i);
+                    axes[i]->stepHigh();
+                }
+            }
+        }
+        if (port != nullptr) {
+            *port |= bits;
+        }
+
+        delayMicroseconds(1);
+
+        if (port != nullptr) {
+            *port &= ~bits;
+        }
+        for (uint8_t i = 0; i < axisCount; i++) {
+            if (others & _BV(i)) {
+                axes[i]->stepLow();
+            }
+        }
+    }
+
+    uint8_t indexOf(StepperMotor* stepper) {
+        for (uint8_t i = 0; i < axisCount; i++) {
+            if (axes[i] == stepper) {
+                return i;
+            }
+        }
+        return MAX_AXES;
+    }
+
+    // Set up Bresenham and schedule the first master step, carry is what the previous move overshot
+    void beginLinear(uint8_t m, uint8_t s, long carry) {
+        master = axes[m];
+        masterMask = _BV(m);
+        slaveMask = axes[s]->isAtTarget() ? 0 : _BV(s);
+        masterSteps = axes[m]->getTotalSteps();
+        slaveSteps = axes[s]->getTotalSteps();
+        error = masterSteps / 2;
+
+        activeMask = 0;
+        if (!axes[m]->isAtTarget()) {
+            remaining[m] = carry + toTicks(axes[m]->getStepInterval());
+            activeMask = masterMask;
+        }
+    }
+
+    // Load the oldest queued segment, the queue slot is released once it is complete
+    bool loadSegment(long carry) {
+        Segment* segment;
+        while ((segment = queue.peek()) != nullptr) {
+            uint8_t m = (abs(segment->steps[1]) > abs(segment->steps[0])) ? 1 : 0;
+            uint8_t s = 1 - m;
+            axes[m]->moveWithProfile(axes[m]->getCurrentPosition() + segment->steps[m], &segment->profile, segment->firstInterval);
+            axes[s]->followTo(axes[s]->getCurrentPosition() + segment->steps[s]);
+            beginLinear(m, s, carry);
+            if (activeMask) {
+                return true;
+            }
+            // Nothing to do in this one
+            queue.pop();
+        }
+        return false;
+    }
+
+    static long toTicks(unsigned long intervalMicros) {
+        return (long)intervalMicros * STEP_TIMER_TICKS_PER_US;
+    }
+
+    // Ticks to the closest deadline, clamped to what the timer can count
+    uint16_t nextPeriod() {
+        long closest = 0xFFFF;
+        for (uint8_t i = 0; i < axisCount; i++) {
+            if ((activeMask & _BV(i)) && remaining[i] < closest) {
+                closest = remaining[i];
+            }
+        }
+        if (closest < MIN_STEP_TIMER_TICKS) {
+            closest = MIN_STEP_TIMER_TICKS;
+        }
+        return closest;
+    }
+};
+
+// Engine instance, the timer ISR needs to reach it
+StepEngine stepEngine;
+
+ISR(TIMER1_COMPA_vect) {
+    stepEngine.onCompare();
+}
+
+#endif // STEP_ENGINE_HPP
@@ -0,0 +1,101 @@
+#ifndef FAST_PIN_HPP
+#define FAST_PIN_HPP
+
+#include <Arduino.h>
+
+#if defined(__AVR_ATmega328P__)
+
+template<uint8_t PIN>
+class FastPin {
+/**
+ * Digital pin resolved at compile time. On the Uno pins 0-7 are on PORTD,
+ * 8-13 on PORTB and A0-A5 (14-19) on PORTC: since both the register and the
+ * bit are constants, each write compiles down to a single sbi/cbi instead of
+ * the table lookups digitalWrite does at runtime.
+ */
+
+public:
+    static_assert(PIN < 20, "FastPin only maps the Uno digital and analog pins");
+
+    static const uint8_t MASK = _BV(PIN < 8 ? PIN : PIN < 14 ? PIN - 8 : PIN - 14);
+
+    static volatile uint8_t& port() {
+        return PIN < 8 ? PORTD : PIN < 14 ? PORTB : PORTC;
+    }
+
+    static volatile uint8_t& ddr() {
+        return PIN < 8 ? DDRD : PIN < 14 ? DDRB : DDRC;
+    }
+
+    static volatile uint8_t& input() {
+        return PIN < 8 ? PIND : PIN < 14 ? PINB : PINC;
+    }
+
+    static void setOutput() {
+        ddr() |= MASK;
+    }
+
+    static void setInputPullup() {
+        ddr() &= ~MASK;
+        port() |= MASK;
+    }
+
+    static void high() {
+        port() |= MASK;
+    }
+
+    static void low() {
+        port() &= ~MASK;
+    }
+
+    static void write(uint8_t value) {
+        if (value) {
+            high();
+        } else {
+            low();
+        }
+    }
+
+    static uint8_t read() {
+        return (input() & MASK) ? HIGH : LOW;
+    }
+};
+
+#else
+
+template<uint8_t PIN>
+class FastPin {
+/**
+ * Portable fallback with the same interface, for boards whose ports are not
+ * mapped above (and for host builds).
+ */
+
+public:
+    static void setOutput() {
+        pinMode(PIN, OUTPUT);
+    }
+
+    static void setInputPullup() {
+        pinMode(PIN, INPUT_PULLUP);
+    }
+
+    static void high() {
+        digitalWrite(PIN, HIGH);
+    }
+
+    static void low() {
+        digitalWrite(PIN, LOW);
+    }
+
+    static void write(uint8_t value) {
+        digitalWrite(PIN, value);
+    }
+
+    static uint8_t read() {
+        return digitalRead(PIN);
+    }
+};
+
+#endif
+
+#endif // FAST_PIN_HPP
@@ -0,0 +1,18 @@
+#ifndef INDICES_HPP
+#define INDICES_HPP
+
+#include <Arduino.h>
+
+// Compile time list of table indices (the AVR toolchain has no std::index_sequence)
+template<uint16_t... I>
+struct Indices {};
+
+template<uint16_t N, uint16_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+
+template<uint16_t... I>
+struct MakeIndices<0, I...> {
+    typedef Indices<I...> type;
+};
+
+#endif // INDICES_HPP
@@ -0,0 +1,128 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "config.hpp"
+#include "automaton.hpp"
+#include "button.hpp"
+
+class InputCapture {
+/**
+ * Input handling for PORTB (pins 8-13, PCINT0-5), i.e. the buttons and the
+ * limit switch, all active low with pull-ups.
+ *
+ * The inputs are debounced together by a ButtonBank, one read of the port
+ * every BUTTON_SAMPLE_MS, and a press posts the event of the input to the
+ * event queue of the automaton. The pin change interrupt only wakes the
+ * sampling up: while nothing moves and no button is down, update() costs
+ * a byte test. The interrupt also latches the raw presses, so trip() sees
+ * the limit switch on its first edge, without waiting for the debounce.
+ *
+ * Held buttons tick through a KeyRepeat, takeRepeats() tells how many
+ * ticks are due since the last call.
+ */
+
+public:
+    EventQueue events;
+
+    InputCapture() : mask(0), buttons(0), repeating(0), awake(false), tripped(0), lastSample(0) {
+        memset(pressEvents, 0, sizeof(pressEvents));
+    }
+
+    // Watch an input (pin 8 to 13), a press posts event (0 for none)
+    void add(uint8_t pin, uint8_t event, bool repeats = false) {
+        uint8_t bit = pin - 8;
+        pinMode(pin, INPUT_PULLUP);
+        pressEvents[bit] = event;
+        mask |= _BV(bit);
+        if (event != 0) {
+            buttons |= _BV(bit);
+        }
+        if (repeats) {
+            repeating |= _BV(bit);
+            repeat.setRepeating(repeating);
+        }
+    }
+
+    // Start capturing, once all the inputs have been added
+    void begin() {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            PCMSK0 |= mask;
+            PCICR |= _BV(PCIE0);
+            awake = true;
+        }
+    }
+
+    // Called from the pin change interrupt
+    void onChange() {
+        tripped |= ~PINB & mask;
+        awake = true;
+    }
+
+    // Sample the inputs and queue the presses, call it from loop()
+    void update() {
+        if (!awake && bank.isSettled() && !(bank.getState() & buttons)) {
+            return;
+        }
+        unsigned long now = millis();
+        if (now - lastSample < BUTTON_SAMPLE_MS) {
+            return;
+        }
+        lastSample = now;
+
+        awake = false;
+        bank.sample(~PINB & mask);
+
+        uint8_t pressed = bank.takePressed();
+        for (uint8_t i = 0; pressed != 0; i++, pressed >>= 1) {
+            if ((pressed & 1) && pressEvents[i] != 0) {
+                events.push(pressEvents[i]);
+            }
+        }
+
+        repeat.update(bank.getHeld() & buttons, now);
+    }
+
+    // Debounced state of an input
+    bool isPressed(uint8_t pin) {
+        return bank.getState() & _BV(pin - 8);
+    }
+
+    // Repeat ticks of a held button since the last call, 0 if none
+    uint8_t takeRepeats(uint8_t pin) {
+        return repeat.take(pin - 8);
+    }
+
+    // Check if an input went down since the last call, on the first edge (not debounced)
+    bool trip(uint8_t pin) {
+        uint8_t bit = _BV(pin - 8);
+        bool result;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            result = (tripped | (~PINB & mask)) & bit;
+            tripped &= ~bit;
+        }
+        return result;
+    }
+
+private:
+    ButtonBank bank;
+    KeyRepeat repeat;
+    uint8_t mask;                       // watched bits of PORTB
+    uint8_t buttons;                    // inputs with a press event
+    uint8_t repeating;                  // buttons that repeat while held
+    volatile bool awake;                // an input changed since the last sample
+    volatile uint8_t tripped;           // raw presses seen by the interrupt
+    unsigned long lastSample;           // ms
+    uint8_t pressEvents[6];
+};
+
+// Capture instance, the pin change ISR needs to reach it
+InputCapture input;
+
+ISR(PCINT0_vect) {
+    input.onChange();
+}
+
+#endif // INPUT_HPP
@@ -0,0 +1,93 @@
+#ifndef JITTER_HPP
+#define JITTER_HPP
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "config.hpp"
+
+#ifdef STEP_JITTER
+
+template<uint8_t AXES>
+class StepJitter {
+/**
+ * Step timing instrumentation (define STEP_JITTER in config.hpp to enable).
+ * For every scheduled pulse the step engine records how late it landed with
+ * respect to its deadline, i.e. the interval the motor asked for: the timer 
+ * ticks elapsed since the compare match when the ISR starts (interrupts held
+ * back by the LCD, the serial port, atomic blocks) plus whatever the engine 
+ * could not honour itself (periods stretched to MIN_STEP_TIMER_TICKS). 
+ *
+ * Deviations go into a fixed histogram per axis, STEP_JITTER_BINS bins of 
+ * 2^STEP_JITTER_BIN_SHIFT ticks each with the last one collecting everything
+ * above, along with the worst case seen. Bresenham slaves are not recorded,
+ * they pulse together with their master.
+ */
+
+public:
+    StepJitter() {
+        reset();
+    }
+
+    // Called from the ISR, lateTicks is never negative
+    void record(uint8_t axis, long lateTicks) {
+        uint16_t ticks = lateTicks > 0xFFFF ? 0xFFFF : lateTicks;
+        if (ticks > worst[axis]) {
+            worst[axis] = ticks;
+        }
+        uint16_t bin = ticks >> STEP_JITTER_BIN_SHIFT;
+        if (bin >= STEP_JITTER_BINS) {
+            bin = STEP_JITTER_BINS - 1;
+        }
+        // Saturate instead of wrapping around
+        if (counts[axis][bin] != 0xFFFF) {
+            counts[axis][bin]++;
+        }
+    }
+
+    void reset() {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            for (uint8_t axis = 0; axis < AXES; axis++) {
+                worst[axis] = 0;
+                for (uint8_t bin = 0; bin < STEP_JITTER_BINS; bin++) {
+                    counts[axis][bin] = 0;
+                }
+            }
+        }
+    }
+
+    // Print the histogram of each axis, bins are labelled with their lower bound in us
+    void dump(Print& out) {
+        for (uint8_t axis = 0; axis < AXES; axis++) {
+            uint16_t snapshot[STEP_JITTER_BINS];
+            uint16_t snapshotWorst;
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                snapshotWorst = worst[axis];
+                for (uint8_t bin = 0; bin < STEP_JITTER_BINS; bin++) {
+                    snapshot[bin] = counts[axis][bin];
+                }
+            }
+
+            out.print(F("Step jitter axis "));
+            out.print(axis);
+            out.print(F(", worst "));
+            out.print((double)snapshotWorst / STEP_TIMER_TICKS_PER_US, 1);
+            out.println(F(" us"));
+
+            for (uint8_t bin = 0; bin < STEP_JITTER_BINS; bin++) {
+                out.print(F("  "));
+                out.print((double)((unsigned long)bin << STEP_JITTER_BIN_SHIFT) / STEP_TIMER_TICKS_PER_US, 1);
+                out.print(bin == STEP_JITTER_BINS - 1 ? F("+ us: ") : F(" us: "));
+                out.println(snapshot[bin]);
+            }
+        }
+    }
+
+private:
+    uint16_t counts[AXES][STEP_JITTER_BINS];
+    uint16_t worst[AXES];   // ticks
+};
+
+#endif // STEP_JITTER
+
+#endif // JITTER_HPP
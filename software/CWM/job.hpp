@@ -0,0 +1,245 @@
+#ifndef JOB_HPP
+#define JOB_HPP
+
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "stepper.hpp"
+#include "engine.hpp"
+#include "planner.hpp"
+
+class Job {
+/**
+ * A motion job, i.e. a sequence of linear moves to absolute positions. Moves
+ * are asked for one at a time, when the planner has room for them, so they
+ * can be computed on the fly instead of being stored.
+ */
+
+public:
+    virtual ~Job() {}
+
+    // Number of moves
+    virtual uint16_t size() = 0;
+
+    // Absolute target of the given move for both axes and the velocity to get there
+    virtual void move(uint16_t index, long& targetLead, long& targetOther, double& velocity) = 0;
+
+    // Check if the motors have to stop at the end of the given move and wait for resume()
+    virtual bool isStop(uint16_t index) {
+        return false;
+    }
+};
+
+class JobRunner {
+/**
+ * Runs a Job cooperatively: update() is called from loop() and only tops up
+ * the planner, the pulses come from the step engine, so the buttons and the
+ * automaton keep being served while the motors move.
+ *
+ * The first motor is the lead axis: its position must move monotonically
+ * towards the last target of the job (true for the coil). Progress is the
+ * fraction of its travel that is done, and after a pause the job resumes
+ * from the first move whose target the lead axis has not reached yet, or
+ * has reached with the other axis still short of its target (a move of the
+ * other axis alone, like the lead-in of a ProgramJob).
+ * Pausing and aborting decelerate the motors to rest (see Planner::stop)
+ * rather than stopping them dead, which could lose steps: the job is only
+ * PAUSED or ABORTED once the engine is idle, and the positions are counted
+ * step by step so nothing is lost.
+ *
+ * The moves are chained up to the next stop of the job (see Job::isStop),
+ * where the motors come to rest and the job is HELD until resume().
+ */
+
+public:
+    enum Status {
+        IDLE,
+        RUNNING,
+        PAUSING,
+        PAUSED,
+        HELD,
+        DONE,
+        ABORTING,
+        ABORTED
+    };
+
+    JobRunner(Planner& _planner, StepEngine& _engine, StepperMotor& _lead, StepperMotor& _other) :
+        planner(_planner), engine(_engine), lead(_lead), other(_other),
+        job(nullptr), status(IDLE), next(0), last(0), startLead(0), endLead(0), percent(0), lastProgress(0) {}
+
+    // Start running a job, nothing happens if another one is in progress
+    void start(Job* _job) {
+        if (isBusy() || _job->size() == 0) {
+            return;
+        }
+
+        long targetOther;
+        double velocity;
+        job = _job;
+        job->move(job->size() - 1, endLead, targetOther, velocity);
+        startLead = lead.getCurrentPosition();
+        percent = 0;
+        lastProgress = millis();
+
+        next = 0;
+        last = findStop(next);
+        planner.syncPosition(lead, other);
+        status = RUNNING;
+    }
+
+    // Bring the motors to rest, resume() continues from where they stop
+    void pause() {
+        if (status != RUNNING) {
+            return;
+        }
+        planner.stop();
+        status = PAUSING;
+    }
+
+    // Continue after pause() or a stop of the job
+    void resume() {
+        if (status != PAUSED && status != HELD) {
+            return;
+        }
+
+        // Skip the moves the lead axis is already past, and those at its position the other axis is done with
+        long position = lead.getCurrentPosition();
+        long sign = (endLead >= startLead) ? 1 : -1;
+        next = 0;
+        while (next < job->size()) {
+            long targetLead, targetOther;
+            double velocity;
+            job->move(next, targetLead, targetOther, velocity);
+            long ahead = (targetLead - position) * sign;
+            if (ahead > 0 || (ahead == 0 && targetOther != other.getCurrentPosition())) {
+                break;
+            }
+            next++;
+        }
+
+        last = findStop(next);
+        planner.syncPosition(lead, other);
+        status = RUNNING;
+    }
+
+    // Bring the motors to rest and drop the job
+    void abort() {
+        if (!isBusy()) {
+            return;
+        }
+        if (status == RUNNING || status == PAUSING) {
+            planner.stop();
+            status = ABORTING;
+        } else {
+            status = ABORTED;
+        }
+    }
+
+    // Feed the planner, true when the progress has to be shown (at most every PROGRESS_UPDATE_MS)
+    bool update() {
+        // Pausing or aborting, done once the motors are at rest
+        if ((status == PAUSING || status == ABORTING) && !engine.isRunning()) {
+            status = (status == PAUSING) ? PAUSED : ABORTED;
+        }
+        if (status != RUNNING) {
+            return false;
+        }
+
+        // Queue as many moves as the planner takes, up to the next stop
+        while (next < last) {
+            long targetLead, targetOther;
+            double velocity;
+            job->move(next, targetLead, targetOther, velocity);
+            if (!planner.moveTo(targetLead, targetOther, velocity)) {
+                break;
+            }
+            next++;
+        }
+
+        // Everything is planned, hand the lookahead window to the engine as room frees up
+        if (next == last && planner.flush() && !engine.isRunning() && engine.queue.isEmpty()) {
+            if (last < job->size()) {
+                status = HELD;
+                percent = computePercent();
+                return true;
+            }
+            status = DONE;
+            percent = 100;
+            return true;
+        }
+
+        unsigned long now = millis();
+        if (now - lastProgress < PROGRESS_UPDATE_MS) {
+            return false;
+        }
+        lastProgress = now;
+
+        uint8_t current = computePercent();
+        if (current == percent) {
+            return false;
+        }
+        percent = current;
+        return true;
+    }
+
+    Status getStatus() {
+        return status;
+    }
+
+    // Check if a job is running, paused or held (or on its way to)
+    bool isBusy() {
+        return status == RUNNING || status == PAUSING || status == PAUSED || status == HELD || status == ABORTING;
+    }
+
+    // Check if the last job is over (done or aborted)
+    bool isOver() {
+        return status == DONE || status == ABORTED;
+    }
+
+    // Forget the last job once its end has been handled
+    void clear() {
+        if (isOver()) {
+            job = nullptr;
+            status = IDLE;
+        }
+    }
+
+    // Percentage of the lead axis travel already done
+    uint8_t getProgress() {
+        return percent;
+    }
+
+private:
+    Planner& planner;
+    StepEngine& engine;
+    StepperMotor& lead;
+    StepperMotor& other;
+
+    Job* job;
+    Status status;
+    uint16_t next;              // next move to hand to the planner
+    uint16_t last;              // end of the moves that chain from next, past the next stop
+    long startLead, endLead;    // lead axis travel
+    uint8_t percent;
+    unsigned long lastProgress; // ms
+
+    // End of the moves that chain from index: past the first stop, or the end of the job
+    uint16_t findStop(uint16_t index) {
+        while (index < job->size() && !job->isStop(index)) {
+            index++;
+        }
+        return (index < job->size()) ? index + 1 : index;
+    }
+
+    uint8_t computePercent() {
+        long travel = endLead - startLead;
+        if (travel == 0) {
+            return 100;
+        }
+        long done = lead.getCurrentPosition() - startLead;
+        long value = (long)((double)done * 100 / travel);
+        return constrain(value, 0, 100);
+    }
+};
+
+#endif // JOB_HPP
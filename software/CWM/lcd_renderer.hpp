@@ -0,0 +1,109 @@
+#ifndef LCD_RENDERER_HPP
+#define LCD_RENDERER_HPP
+
+#include <Arduino.h>
+#include <LiquidCrystal_I2C.h>
+
+#include "config.hpp"
+
+class LcdRenderer {
+/**
+ * Shadow framebuffer for the character LCD. Text is written into the frame
+ * in memory, which costs nothing, and flush() brings the display up to date
+ * a few bytes at a time: only the cells that differ from what the display
+ * shows are sent, and the cursor is only moved when the next changed cell
+ * is not the one the display would write to anyway. No clear, no flicker,
+ * and loop() never stalls on the I2C bus for a whole screen.
+ *
+ * Characters 8-15 show the custom glyphs 0-7 (the display maps both ranges
+ * to CGRAM), so glyphs can live in plain null-terminated strings.
+ */
+
+public:
+    LcdRenderer(LiquidCrystal_I2C& _lcd) : lcd(_lcd), cursorCol(NONE), cursorRow(NONE), dirty(false) {
+        memset(frame, ' ', sizeof(frame));
+        memset(shown, ' ', sizeof(shown));
+    }
+
+    // The display has just been cleared, align the shadow with it
+    void reset() {
+        memset(shown, ' ', sizeof(shown));
+        cursorCol = cursorRow = NONE;
+        dirty = true;
+    }
+
+    // Write text at a position, it stops at the end of the row
+    void print(uint8_t col, uint8_t row, const char* text) {
+        if (row >= LCD_ROWS) {
+            return;
+        }
+        while (col < LCD_COLS && *text != '\0') {
+            set(col++, row, *text++);
+        }
+    }
+
+    // Replace a whole row, the rest of it is blanked
+    void setRow(uint8_t row, const char* text) {
+        if (row >= LCD_ROWS) {
+            return;
+        }
+        for (uint8_t col = 0; col < LCD_COLS; col++) {
+            set(col, row, *text != '\0' ? *text++ : ' ');
+        }
+    }
+
+    // Send at most maxBytes bytes of changes to the display (a cursor move counts as one)
+    void flush(uint8_t maxBytes = LCD_BYTES_PER_FLUSH) {
+        if (!dirty) {
+            return;
+        }
+
+        for (uint8_t row = 0; row < LCD_ROWS; row++) {
+            for (uint8_t col = 0; col < LCD_COLS; col++) {
+                if (frame[row][col] == shown[row][col]) {
+                    continue;
+                }
+                if (maxBytes == 0) {
+                    return;
+                }
+                if (col != cursorCol || row != cursorRow) {
+                    lcd.setCursor(col, row);
+                    cursorCol = col;
+                    cursorRow = row;
+                    if (--maxBytes == 0) {
+                        return;
+                    }
+                }
+                lcd.write(frame[row][col]);
+                shown[row][col] = frame[row][col];
+                cursorCol++;
+                maxBytes--;
+            }
+        }
+
+        // Went through the whole frame, the display is up to date
+        dirty = false;
+    }
+
+    bool isDirty() {
+        return dirty;
+    }
+
+private:
+    static const uint8_t NONE = 0xFF;
+
+    LiquidCrystal_I2C& lcd;
+    char frame[LCD_ROWS][LCD_COLS];     // what should be shown
+    char shown[LCD_ROWS][LCD_COLS];     // what the display shows
+    uint8_t cursorCol, cursorRow;       // where the display writes next
+    bool dirty;
+
+    void set(uint8_t col, uint8_t row, char c) {
+        if (frame[row][col] != c) {
+            frame[row][col] = c;
+            dirty = true;
+        }
+    }
+};
+
+#endif // LCD_RENDERER_HPP
@@ -1,8 +1,27 @@
 #ifndef LOGGER_HPP
 #define LOGGER_HPP
 
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "ring_buffer.hpp"
 
 class Logger {
+/**
+ * Allocation-free logger. Each record is formatted into a fixed line buffer,
+ * replacing every {} in the format with the next argument, and queued in a
+ * ring buffer that drain() hands to the serial port only as fast as it can
+ * take it, so logging never blocks. Records that do not fit in the queue
+ * are dropped whole (and counted), lines longer than LOG_LINE_SIZE are cut.
+ *
+ * Formats can live in flash: Logger::debug(F("Layer {} done"), layer).
+ *
+ * Levels above LOG_MAX_LEVEL (config.hpp) are removed at compile time: the
+ * level of info(), debug() and so on is a constant, so the whole call folds 
+ * away, arguments included as long as they have no side effects. The level
+ * set with setLogLevel() filters what is left at runtime.
+ */
+
 public:
     enum LogLevel {
         INFO,
@@ -16,112 +35,244 @@ public:
     }
 
     template<typename... Args>
-    static void log(LogLevel level, const char* format, Args... args) {
+    static void log(LogLevel level, const __FlashStringHelper* format, Args... args) {
         /**
-         * Logging function with log level and variable arguments.
+         * Logging function with log level and variable arguments, format in flash.
          */
 
-        if (level <= currentLogLevel) {
-            String formattedMessage = formatString(format, args...);
-            Serial.print(currentTime());
-            Serial.print(" [");
-            Serial.print(logLevelToString(level));
-            Serial.print("]: ");
-            Serial.println(formattedMessage);
+        if (isEnabled(level)) {
+            begin(level);
+            formatToLine(reinterpret_cast<const char*>(format), true, args...);
+            end();
         }
     }
 
-    // Logging functions for specific log levels
     template<typename... Args>
-    static void info(const char* format, Args... args) {
-        log(INFO, format, args...);
+    static void log(LogLevel level, const char* format, Args... args) {
+        /**
+         * Logging function with log level and variable arguments, format in RAM.
+         */
+
+        if (isEnabled(level)) {
+            begin(level);
+            formatToLine(format, false, args...);
+            end();
+        }
     }
 
-    template<typename... Args>
-    static void debug(const char* format, Args... args) {
-        log(DEBUG, format, args...);
+    // Logging functions for specific log levels, compiled out above LOG_MAX_LEVEL
+    template<typename Format, typename... Args>
+    static void info(Format format, Args... args) {
+        if (INFO <= LOG_MAX_LEVEL) {
+            log(INFO, format, args...);
+        }
     }
 
-    template<typename... Args>
-    static void warn(const char* format, Args... args) {
-        log(WARN, format, args...);
+    template<typename Format, typename... Args>
+    static void debug(Format format, Args... args) {
+        if (DEBUG <= LOG_MAX_LEVEL) {
+            log(DEBUG, format, args...);
+        }
     }
 
-    template<typename... Args>
-    static void error(const char* format, Args... args) {
-        log(ERROR, format, args...);
+    template<typename Format, typename... Args>
+    static void warn(Format format, Args... args) {
+        if (WARN <= LOG_MAX_LEVEL) {
+            log(WARN, format, args...);
+        }
+    }
+
+    template<typename Format, typename... Args>
+    static void error(Format format, Args... args) {
+        if (ERROR <= LOG_MAX_LEVEL) {
+            log(ERROR, format, args...);
+        }
+    }
+
+    // Check if a level is compiled in and currently enabled
+    static bool isEnabled(LogLevel level) {
+        return level <= LOG_MAX_LEVEL && level <= currentLogLevel;
+    }
+
+    // Hand the queued records to the serial port without blocking, call it from loop()
+    static void drain() {
+        int room = Serial.availableForWrite();
+        char* c;
+        while (room-- > 0 && (c = buffer.peek()) != nullptr) {
+            Serial.write(*c);
+            buffer.pop();
+        }
+    }
+
+    // Write out all the queued records, blocking
+    static void flush() {
+        char* c;
+        while ((c = buffer.peek()) != nullptr) {
+            Serial.write(*c);
+            buffer.pop();
+        }
+    }
+
+    // Number of records dropped because the queue was full
+    static uint16_t getDropped() {
+        return dropped;
     }
 
 private:
 
     static LogLevel currentLogLevel;
 
+    static char line[LOG_LINE_SIZE];
+    static uint8_t length;
+    static RingBuffer<char, LOG_BUFFER_SIZE> buffer;
+    static uint16_t dropped;
+
+    static char formatChar(const char* format, bool progmem) {
+        return progmem ? pgm_read_byte(format) : *format;
+    }
+
     template<typename T, typename... Args>
-    static void formatToString(String &result, const char* format, T value, Args... args) {
+    static void formatToLine(const char* format, bool progmem, T value, Args... args) {
         /**
-         * Recursively format the string with arguments.
+         * Recursively format the line with arguments.
          */
 
-        const char* placeholder = strstr(format, "{}");
-        if (placeholder != nullptr) {
-            result += String(format).substring(0, placeholder - format); // Before {}
-            result += String(value); // Insert argument
-            formatToString(result, placeholder + 2, args...); // Process next argument
-        } else {
-            result += String(format); // Append remaining string if no more placeholders
+        char c;
+        while ((c = formatChar(format, progmem)) != '\0') {
+            if (c == '{' && formatChar(format + 1, progmem) == '}') {
+                append(value);                                  // Insert argument
+                formatToLine(format + 2, progmem, args...);     // Process next argument
+                return;
+            }
+            append(c);
+            format++;
         }
     }
 
-    static void formatToString(String &result, const char* format) {
+    static void formatToLine(const char* format, bool progmem) {
         /**
          * Base case: when no more arguments are left, just append the rest of the format.
          */
 
-        result += String(format);
+        char c;
+        while ((c = formatChar(format++, progmem)) != '\0') {
+            append(c);
+        }
     }
 
-    template<typename... Args>
-    static String formatString(const char* format, Args... args) {
+    // Append to the line, keeping room for the line terminator
+    static void append(char c) {
+        if (length < LOG_LINE_SIZE - 2) {
+            line[length++] = c;
+        }
+    }
+
+    static void append(const char* text) {
+        while (*text != '\0') {
+            append(*text++);
+        }
+    }
+
+    static void append(const __FlashStringHelper* text) {
+        const char* p = reinterpret_cast<const char*>(text);
+        char c;
+        while ((c = pgm_read_byte(p++)) != '\0') {
+            append(c);
+        }
+    }
+
+    static void append(unsigned long value, uint8_t width = 0, char pad = ' ') {
+        char digits[10];
+        uint8_t count = 0;
+        do {
+            digits[count++] = '0' + value % 10;
+            value /= 10;
+        } while (value > 0);
+        while (width-- > count) {
+            append(pad);
+        }
+        while (count > 0) {
+            append(digits[--count]);
+        }
+    }
+
+    static void append(long value) {
+        if (value < 0) {
+            append('-');
+            append((unsigned long)(-(value + 1)) + 1);
+        } else {
+            append((unsigned long)value);
+        }
+    }
+
+    static void append(unsigned int value) {
+        append((unsigned long)value);
+    }
+
+    static void append(int value) {
+        append((long)value);
+    }
+
+    static void append(double value) {
+        char text[16];
+        dtostrf(value, 0, 2, text);
+        append(text);
+    }
+
+    static void begin(LogLevel level) {
         /**
-         * Helper to kick off the recursive formatting.
+         * Start a record with the current time (mm:ss, padded to 10 chars) and the log level.
          */
 
-        String result = "";
-        formatToString(result, format, args...);
-        return result;
+        unsigned long now = millis() / 1000;
+        length = 0;
+        append(now / 60, 4);
+        append(':');
+        append(now % 60, 2, '0');
+        append(F("  ["));
+        append(logLevelToString(level));
+        append(F("]: "));
     }
 
-    static const char* logLevelToString(LogLevel level) {
+    static void end() {
         /**
-         * Convert log level to string.
+         * Terminate the record and queue it, or drop it if it does not fit.
          */
 
-        switch (level) {
-            case INFO:  return "INFO ";
-            case WARN:  return "WARN ";
-            case DEBUG: return "DEBUG";
-            case ERROR: return "ERROR";
-            default:    return "UNKNOWN";
+        line[length++] = '\r';
+        line[length++] = '\n';
+
+        // Make room with whatever the serial port can take right now
+        drain();
+        if ((uint8_t)(LOG_BUFFER_SIZE - buffer.count()) < length) {
+            dropped++;
+            return;
+        }
+        for (uint8_t i = 0; i < length; i++) {
+            buffer.push(line[i]);
         }
     }
 
-    static String currentTime() {
+    static const __FlashStringHelper* logLevelToString(LogLevel level) {
         /**
-         * Get current time for the log entry (formatted as mm:ss, padded to 10 chars).
+         * Convert log level to string.
          */
-        unsigned long now = millis() / 1000;
-        unsigned int minutes = now / 60;
-        unsigned int seconds = now % 60;
-
-        // Format minutes and seconds as "mm:ss"
-        char buffer[11]; // 10 chars + null terminator
-        snprintf(buffer, sizeof(buffer), "%4d:%02d ", minutes, seconds);
 
-        return String(buffer);
+        switch (level) {
+            case INFO:  return F("INFO ");
+            case WARN:  return F("WARN ");
+            case DEBUG: return F("DEBUG");
+            case ERROR: return F("ERROR");
+            default:    return F("UNKNOWN");
+        }
     }
 };
 
-// Initialize the static member
+// Initialize the static members
 Logger::LogLevel Logger::currentLogLevel = Logger::INFO;
+char Logger::line[LOG_LINE_SIZE];
+uint8_t Logger::length = 0;
+RingBuffer<char, LOG_BUFFER_SIZE> Logger::buffer;
+uint16_t Logger::dropped = 0;
 
 #endif // LOGGER_HPP
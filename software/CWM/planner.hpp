@@ -0,0 +1,199 @@
+#ifndef PLANNER_HPP
+#define PLANNER_HPP
+
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "engine.hpp"
+
+class Planner {
+/**
+ * Turns a sequence of linear moves into segments the step engine can chain
+ * without stopping. New moves wait in a lookahead window where their entry
+ * velocities are planned: the velocity at each junction is limited by the
+ * change of direction (no axis may jump by more than JUNCTION_JERK_STEPS_S)
+ * and by what can be reached accelerating forward and decelerating backward,
+ * assuming the machine has to stop at the end of the window. The oldest move
+ * is handed to the engine queue when the window is full or on flush(), with 
+ * its speed profile already computed so the ISR only has to load it.
+ *
+ * Velocities are in steps/s of the axis with more steps (the master) of each 
+ * move, like the segments of StepEngine. The producer is expected to keep
+ * the engine queue fed: when it runs dry the motors stop where they are.
+ */
+
+public:
+    Planner(StepEngine& _engine) : engine(_engine), first(0), count(0), exitVelocity(MIN_VELOCITY_STEPS_S) {
+        previous.masterSteps = 0;
+        for (uint8_t i = 0; i < StepEngine::MAX_AXES; i++) {
+            position[i] = 0;
+        }
+    }
+
+    // Start planning from where the motors are now
+    void syncPosition(StepperMotor& a, StepperMotor& b) {
+        position[0] = a.getCurrentPosition();
+        position[1] = b.getCurrentPosition();
+    }
+
+    // Queue a linear move to the given absolute positions, false if there is no room yet
+    bool moveTo(long targetA, long targetB, double velocity) {
+        return addSegment(targetA - position[0], targetB - position[1], velocity);
+    }
+
+    // Queue a linear move by the given number of steps, false if there is no room yet
+    bool addSegment(long stepsA, long stepsB, double velocity) {
+        if (stepsA == 0 && stepsB == 0) {
+            return true;
+        }
+        if (count == PLANNER_LOOKAHEAD && !commit()) {
+            return false;
+        }
+
+        // Nothing ahead of this move, it starts from standstill
+        if (count == 0 && engine.queue.isEmpty() && !engine.isRunning()) {
+            exitVelocity = MIN_VELOCITY_STEPS_S;
+            previous.masterSteps = 0;
+        }
+
+        Block& block = blocks[(first + count) % PLANNER_LOOKAHEAD];
+        block.steps[0] = stepsA;
+        block.steps[1] = stepsB;
+        block.master = (abs(stepsB) > abs(stepsA)) ? 1 : 0;
+        block.masterSteps = abs(block.steps[block.master]);
+        block.nominalVelocity = velocity;
+        block.maxEntryVelocity = junctionVelocity(block);
+        count++;
+
+        position[0] += stepsA;
+        position[1] += stepsB;
+        previous = block;
+
+        recalculate();
+        return true;
+    }
+
+    // Hand every planned move to the engine, false if the engine queue filled up first
+    bool flush() {
+        while (count > 0) {
+            if (!commit()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Check if there are moves still waiting in the lookahead window
+    bool isEmpty() {
+        return count == 0;
+    }
+
+    // Drop the lookahead window (the engine queue is cleared by StepEngine::stop)
+    void clear() {
+        count = 0;
+    }
+
+    // Drop everything that is planned and bring the motors to rest, decelerating down to MIN_VELOCITY_STEPS_S
+    void stop() {
+        count = 0;
+        engine.brake(ACCELERATION, MIN_VELOCITY_STEPS_S);
+    }
+
+private:
+    struct Block {
+        long steps[StepEngine::MAX_AXES];
+        long masterSteps;
+        uint8_t master;
+        double nominalVelocity;
+        double maxEntryVelocity;    // junction limit
+        double entryVelocity;       // planned
+    };
+
+    StepEngine& engine;
+    Block blocks[PLANNER_LOOKAHEAD];
+    uint8_t first, count;
+    Block previous;                 // last move added
+    double exitVelocity;            // exit velocity of the last move handed to the engine
+    long position[StepEngine::MAX_AXES];
+
+    // Highest velocity at the junction with the previous move
+    double junctionVelocity(const Block& block) {
+        if (previous.masterSteps == 0 || previous.master != block.master) {
+            return MIN_VELOCITY_STEPS_S;
+        }
+
+        double velocity = min(block.nominalVelocity, previous.nominalVelocity);
+        for (uint8_t i = 0; i < StepEngine::MAX_AXES; i++) {
+            // Velocity of the axis per unit of master velocity, before and after
+            double before = (double)previous.steps[i] / previous.masterSteps;
+            double after = (double)block.steps[i] / block.masterSteps;
+            double change = fabs(after - before);
+            if (change * velocity > JUNCTION_JERK_STEPS_S) {
+                velocity = JUNCTION_JERK_STEPS_S / change;
+            }
+        }
+        return velocity;
+    }
+
+    static double reachable(double velocity, long steps) {
+        return sqrt(velocity * velocity + 2 * ACCELERATION * steps);
+    }
+
+    void recalculate() {
+        // Backward pass: every move must be able to slow down for the next one, and to stop at the end
+        double next = MIN_VELOCITY_STEPS_S;
+        for (int8_t i = count - 1; i >= 0; i--) {
+            Block& block = blocks[(first + i) % PLANNER_LOOKAHEAD];
+            block.entryVelocity = min(block.maxEntryVelocity, reachable(next, block.masterSteps));
+            next = block.entryVelocity;
+        }
+
+        // Forward pass: the first move starts where the engine will leave off, the others can't accelerate more than allowed
+        double previousEntry = exitVelocity;
+        long previousSteps = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            Block& block = blocks[(first + i) % PLANNER_LOOKAHEAD];
+            if (i == 0) {
+                block.entryVelocity = exitVelocity;
+            } else {
+                block.entryVelocity = min(block.entryVelocity, reachable(previousEntry, previousSteps));
+            }
+            previousEntry = block.entryVelocity;
+            previousSteps = block.masterSteps;
+        }
+    }
+
+    // Hand the oldest move to the engine
+    bool commit() {
+        StepEngine::Segment segment;
+        if (count == 0 || engine.queue.isFull()) {
+            return false;
+        }
+
+        Block& block = blocks[first];
+        double entry = block.entryVelocity;
+        if (!engine.isRunning() && engine.queue.isEmpty()) {
+            // The engine ran dry and the motors stopped, start over
+            entry = min(entry, MIN_VELOCITY_STEPS_S);
+        }
+        double exit = (count > 1) ? blocks[(first + 1) % PLANNER_LOOKAHEAD].entryVelocity : MIN_VELOCITY_STEPS_S;
+        double cruise = max(block.nominalVelocity, max(entry, exit));
+
+        segment.steps[0] = block.steps[0];
+        segment.steps[1] = block.steps[1];
+        segment.profile.compute(block.masterSteps, entry, exit, cruise, ACCELERATION);
+        segment.firstInterval = 1e6 / entry;
+        engine.queue.push(segment);
+
+        exitVelocity = exit;
+        first = (first + 1) % PLANNER_LOOKAHEAD;
+        count--;
+
+        if (!engine.isRunning()) {
+            engine.startStream();
+        }
+        return true;
+    }
+};
+
+#endif // PLANNER_HPP
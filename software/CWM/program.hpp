@@ -0,0 +1,387 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "logger.hpp"
+#include "job.hpp"
+
+// Segment flags
+const uint8_t SEGMENT_TAP = 1;      // stop at the end of the segment until the job is resumed
+
+// One move of a program, integers only
+struct ProgramSegment {
+    long steps[2];      // relative steps of the coil and of the feeder, the sign gives the direction
+    uint16_t rate;      // steps/s of the axis with more steps
+    uint8_t flags;      // SEGMENT_*
+};
+
+class SegmentProgram {
+/**
+ * A motion program: a bounded list of relative moves of the coil and of the
+ * feeder, already turned into integers. A program is compiled once, before
+ * the motors start, so running it only takes adding the steps up.
+ */
+
+public:
+    SegmentProgram() : count(0) {}
+
+    void clear() {
+        count = 0;
+    }
+
+    // Append a move, false if the program is full
+    bool add(long coilSteps, long feederSteps, uint16_t rate) {
+        if (count == PROGRAM_SEGMENTS) {
+            return false;
+        }
+        ProgramSegment& segment = segments[count++];
+        segment.steps[0] = coilSteps;
+        segment.steps[1] = feederSteps;
+        segment.rate = rate;
+        segment.flags = 0;
+        return true;
+    }
+
+    // Stop at the end of the last segment, false if there is none
+    bool tap() {
+        if (count == 0) {
+            return false;
+        }
+        segments[count - 1].flags |= SEGMENT_TAP;
+        return true;
+    }
+
+    uint8_t size() {
+        return count;
+    }
+
+    const ProgramSegment& get(uint8_t index) {
+        return segments[index];
+    }
+
+private:
+    ProgramSegment segments[PROGRAM_SEGMENTS];
+    uint8_t count;
+};
+
+class CoilCompiler {
+/**
+ * Compiles a coil, one section after the other, into a SegmentProgram. The
+ * feeder traverses the spool back and forth while the coil keeps turning
+ * the same way: a section is cut into one segment per stretch between two
+ * reversals, and the traverse carries over from a section to the next, so
+ * sections of different wire and pitch chain into one continuous job. Each
+ * reversal starts a layer, the coil slows down as the diameter grows so
+ * that the wire is pulled at the same speed.
+ *
+ * Turns and feeder travel are summed from the start of the coil and only
+ * rounded to steps there, so the pitch never drifts.
+ */
+
+public:
+    CoilCompiler(SegmentProgram& _program) : program(_program) {
+        begin(0, 0);
+    }
+
+    // Start a new coil on an empty spool (mm), the feeder at home
+    void begin(double _spoolLength, double _spoolDiameter) {
+        program.clear();
+        spoolLength = _spoolLength;
+        spoolDiameter = _spoolDiameter;
+        currentDiameter = _spoolDiameter;
+        turns = 0;
+        offset = 0;
+        away = true;
+        coilSteps = 0;
+        feederSteps = 0;
+    }
+
+    // Wind some turns of wire (mm) at pitch mm per turn, false if the program is full
+    bool addSection(double wireDiameter, double sectionTurns, double pitch) {
+        while (sectionTurns > EPSILON) {
+            // mm left before the feeder has to turn around
+            double room = away ? spoolLength - offset : offset;
+            if (room < EPSILON) {
+                away = !away;
+                currentDiameter += 2 * wireDiameter;
+                continue;
+            }
+
+            double n = min(sectionTurns, room / pitch);
+            turns += n;
+            offset += away ? n * pitch : -n * pitch;
+            sectionTurns -= n;
+            if (!emit()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Stop after what has been added so far, false if there is nothing yet
+    bool addTap() {
+        return program.tap();
+    }
+
+private:
+    static constexpr double EPSILON = 1e-3;    // turns or mm, below a step
+
+    SegmentProgram& program;
+    double spoolLength, spoolDiameter, currentDiameter;    // mm
+    double turns;                   // from the start of the coil
+    double offset;                  // mm, feeder from home
+    bool away;                      // the feeder moves away from home
+    long coilSteps, feederSteps;    // where the program ends so far
+
+    bool emit() {
+        // The feeder moves towards negative positions going away from home
+        long coil = lround(turns * STEPS_PER_REVOLUTION * MICROSTEPPING);
+        long feeder = -lround(offset * STEPS_PER_MM);
+        long coilDelta = coil - coilSteps;
+        long feederDelta = feeder - feederSteps;
+
+        // The rate is for the master axis: past a pitch of LEAD it is the feeder, scaled so the coil keeps its rate
+        double rate = WINDING_VELOCITY_STEPS_S * spoolDiameter / currentDiameter;
+        if (labs(feederDelta) > labs(coilDelta) && coilDelta != 0) {
+            rate = min(rate * labs(feederDelta) / labs(coilDelta), MAX_VELOCITY_STEPS_S);
+        }
+
+        if (!program.add(coilDelta, feederDelta, lround(rate))) {
+            return false;
+        }
+        coilSteps = coil;
+        feederSteps = feeder;
+        return true;
+    }
+};
+
+// Compile a uniform coil: layerCount layers of turns at the pitch of the wire, false if the program is full
+bool compileWinding(SegmentProgram& program, double wireDiameter, double spoolLength, double spoolDiameter, uint8_t layerCount) {
+    CoilCompiler compiler(program);
+    compiler.begin(spoolLength, spoolDiameter);
+    return compiler.addSection(wireDiameter, layerCount * spoolLength / wireDiameter, wireDiameter);
+}
+
+class ProgramJob : public Job {
+/**
+ * Runs a SegmentProgram from where the coil is when it begins. The feeder
+ * moves are anchored to home, as CoilCompiler builds them: if the feeder
+ * isn't there (the last coil ended on an odd layer) the job starts with a
+ * move that brings it back, the coil at rest. The moves are asked for in
+ * order, so the absolute targets are kept as a running sum
+ * and only rebuilt from the start when an earlier move is asked for (when
+ * the job starts or resumes).
+ */
+
+public:
+    ProgramJob(SegmentProgram& _program) : program(_program), leadIn(0), cursor(0) {
+        origin[0] = origin[1] = 0;
+        position[0] = position[1] = 0;
+    }
+
+    // Run the program from the given coil position, the feeder from home
+    void begin(long coil, long feeder) {
+        origin[0] = coil;
+        origin[1] = 0;
+        leadIn = (feeder != 0) ? 1 : 0;
+        cursor = 0;
+        position[0] = origin[0];
+        position[1] = origin[1];
+    }
+
+    uint16_t size() override {
+        return program.size() + leadIn;
+    }
+
+    void move(uint16_t index, long& targetCoil, long& targetFeeder, double& velocity) override {
+        if (index < leadIn) {
+            targetCoil = origin[0];
+            targetFeeder = origin[1];
+            velocity = HOMING_VELOCITY_STEPS_S;
+            return;
+        }
+        index -= leadIn;
+
+        if (index < cursor) {
+            cursor = 0;
+            position[0] = origin[0];
+            position[1] = origin[1];
+        }
+        while (cursor <= index) {
+            const ProgramSegment& segment = program.get(cursor++);
+            position[0] += segment.steps[0];
+            position[1] += segment.steps[1];
+        }
+        targetCoil = position[0];
+        targetFeeder = position[1];
+        velocity = program.get(index).rate;
+    }
+
+    bool isStop(uint16_t index) override {
+        return index >= leadIn && (program.get(index - leadIn).flags & SEGMENT_TAP);
+    }
+
+private:
+    SegmentProgram& program;
+    long origin[2];
+    uint8_t leadIn;         // 1 while the feeder has to be brought home first
+    uint16_t cursor;        // next segment to add up
+    long position[2];       // end of the segment before cursor
+};
+
+class ProgramLoader {
+/**
+ * Loads a coil program sent over Serial, one command per line:
+ *
+ *   N                          new program, on the spool set in the menu
+ *   S <wire> <turns> [<pitch>] section: turns of wire (mm) at pitch mm per
+ *                              turn, the wire diameter if not given
+ *   T                          tap: stop after the section above until the
+ *                              job is resumed
+ *   E                          end, winding runs the program from now on
+ *   X                          drop the program, back to the menu parameters
+ *
+ * Each line is compiled as soon as it arrives, so only the line being
+ * received is buffered and the program lives in the bounded SegmentProgram.
+ * Bytes are taken as they come, update() never waits for the port. A line
+ * that can't be read or doesn't fit fails the whole program, until the next
+ * N.
+ */
+
+public:
+    enum Status {
+        IDLE,
+        LOADING,
+        READY,
+        FAILED
+    };
+
+    ProgramLoader(CoilCompiler& _compiler, const float& _spoolLength, const float& _spoolDiameter) :
+        compiler(_compiler), spoolLength(_spoolLength), spoolDiameter(_spoolDiameter), status(IDLE), length(0), overflow(false) {}
+
+    // Take the bytes waiting on the port, call it from loop()
+    void update() {
+        while (Serial.available()) {
+            take(Serial.read());
+        }
+    }
+
+    // Take one byte, for when the port is shared with other commands
+    void take(char c) {
+        if (c == '\r') {
+            return;
+        }
+        if (c != '\n') {
+            // Longer lines are dropped whole when they end
+            if (length < PROGRAM_LINE_SIZE - 1) {
+                line[length++] = c;
+            } else {
+                overflow = true;
+            }
+            return;
+        }
+        line[length] = '\0';
+        length = 0;
+        if (overflow) {
+            overflow = false;
+            if (status == LOADING) {
+                fail(F("line too long"));
+            }
+            return;
+        }
+        execute(line);
+    }
+
+    // Check if a line is partly received
+    bool isInLine() {
+        return length > 0 || overflow;
+    }
+
+    // Check if a complete program is loaded
+    bool isReady() {
+        return status == READY;
+    }
+
+    // Forget the program, the buffer is about to be reused
+    void drop() {
+        status = IDLE;
+    }
+
+    Status getStatus() {
+        return status;
+    }
+
+private:
+    CoilCompiler& compiler;
+    const float& spoolLength;       // mm
+    const float& spoolDiameter;     // mm
+    Status status;
+    char line[PROGRAM_LINE_SIZE];
+    uint8_t length;
+    bool overflow;                  // the line doesn't fit, it is rejected
+
+    void execute(char* text) {
+        switch (text[0]) {
+            case 'N':
+                compiler.begin(spoolLength, spoolDiameter);
+                status = LOADING;
+                break;
+
+            case 'S':
+                if (status == LOADING) {
+                    section(text + 1);
+                }
+                break;
+
+            case 'T':
+                if (status == LOADING && !compiler.addTap()) {
+                    fail(F("tap before any section"));
+                }
+                break;
+
+            case 'E':
+                if (status == LOADING) {
+                    status = READY;
+                    Logger::info(F("Program loaded"));
+                }
+                break;
+
+            case 'X':
+                status = IDLE;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void section(char* text) {
+        char* end;
+        double wire = strtod(text, &end);
+        double turns = strtod(end, &text);
+        if (text == end || wire <= 0 || turns <= 0) {
+            fail(F("bad section"));
+            return;
+        }
+        double pitch = strtod(text, &end);
+        if (end == text) {
+            pitch = wire;
+        }
+        if (pitch <= 0) {
+            fail(F("bad pitch"));
+            return;
+        }
+        if (!compiler.addSection(wire, turns, pitch)) {
+            fail(F("too many segments"));
+        }
+    }
+
+    void fail(const __FlashStringHelper* reason) {
+        Logger::error(F("Program: {}"), reason);
+        status = FAILED;
+    }
+};
+
+#endif // PROGRAM_HPP
@@ -0,0 +1,54 @@
+#ifndef RAMP_TABLE_HPP
+#define RAMP_TABLE_HPP
+
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "indices.hpp"
+
+/**
+ * The standard ramp goes from MIN_VELOCITY_STEPS_S to MAX_VELOCITY_STEPS_S
+ * with ACCELERATION. All of them are known at compile time, so the step 
+ * intervals along the ramp are generated by the compiler and stored in flash.
+ * The ramp index i is the number of steps taken from MIN_VELOCITY_STEPS_S:
+ *
+ *   v(i) = sqrt(MIN_VELOCITY_STEPS_S^2 + 2 * ACCELERATION * i)
+ *
+ * Storing every single step would take ~20 KB, so the table keeps one entry
+ * every 2^RAMP_TABLE_SHIFT steps and TableSpeedProfile interpolates between them.
+ */
+
+/* ----------------------------- Table generation ---------------------------- */
+
+// Square root usable in constant expressions (Newton, the ramp velocities are all below the guess)
+constexpr double rampSqrt(double x, double guess = MAX_VELOCITY_STEPS_S, uint8_t iterations = 12) {
+    return iterations == 0 ? guess : rampSqrt(x, 0.5 * (guess + x / guess), iterations - 1);
+}
+
+// Number of steps needed to reach MAX_VELOCITY_STEPS_S
+constexpr uint16_t RAMP_STEPS = (MAX_VELOCITY_STEPS_S * MAX_VELOCITY_STEPS_S - MIN_VELOCITY_STEPS_S * MIN_VELOCITY_STEPS_S) / (2 * ACCELERATION);
+
+// One more entry to interpolate the last stretch and one to round up
+constexpr uint16_t RAMP_TABLE_SIZE = (RAMP_STEPS >> RAMP_TABLE_SHIFT) + 2;
+
+// Step interval (us, rounded) at ramp index i
+constexpr uint16_t rampInterval(uint32_t i) {
+    return 1e6 / rampSqrt(MIN_VELOCITY_STEPS_S * MIN_VELOCITY_STEPS_S + 2 * ACCELERATION * i) + 0.5;
+}
+
+template<typename List>
+struct RampTable;
+
+template<uint16_t... I>
+struct RampTable<Indices<I...>> {
+    static constexpr uint16_t intervals[sizeof...(I)] PROGMEM = {
+        rampInterval((uint32_t)I << RAMP_TABLE_SHIFT)...
+    };
+};
+
+template<uint16_t... I>
+constexpr uint16_t RampTable<Indices<I...>>::intervals[sizeof...(I)];
+
+typedef RampTable<MakeIndices<RAMP_TABLE_SIZE>::type> StandardRampTable;
+
+#endif // RAMP_TABLE_HPP
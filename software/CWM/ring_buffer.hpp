@@ -0,0 +1,79 @@
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <Arduino.h>
+
+template<typename T, uint8_t N>
+class RingBuffer {
+/**
+ * Lock-free single-producer/single-consumer queue. The producer only writes
+ * head and the consumer only writes tail: both are single bytes, so they are
+ * read and written atomically on the AVR and no interrupt needs to be masked 
+ * on either side. The capacity must be a power of two.
+ *
+ * The consumer can work on the oldest item in place (peek) and release the
+ * slot only when done with it (pop).
+ */
+
+public:
+    static_assert(N > 0 && (N & (N - 1)) == 0, "RingBuffer capacity must be a power of two");
+
+    RingBuffer() : head(0), tail(0) {}
+
+    // Producer side: copy an item in, false if the buffer is full
+    bool push(const T& item) {
+        if (isFull()) {
+            return false;
+        }
+        items[head & MASK] = item;
+        barrier();
+        head = head + 1;
+        return true;
+    }
+
+    // Consumer side: oldest item, nullptr if the buffer is empty
+    T* peek() {
+        if (isEmpty()) {
+            return nullptr;
+        }
+        return &items[tail & MASK];
+    }
+
+    // Consumer side: release the oldest item
+    void pop() {
+        if (!isEmpty()) {
+            barrier();
+            tail = tail + 1;
+        }
+    }
+
+    bool isEmpty() const {
+        return head == tail;
+    }
+
+    bool isFull() const {
+        return (uint8_t)(head - tail) == N;
+    }
+
+    uint8_t count() const {
+        return head - tail;
+    }
+
+    // Drop everything, only safe while the other side is not running
+    void clear() {
+        tail = head;
+    }
+
+private:
+    static const uint8_t MASK = N - 1;
+
+    T items[N];
+    volatile uint8_t head, tail;   // free running, wrapped with MASK
+
+    // Keep the compiler from moving the item accesses past the index update
+    static inline void barrier() {
+        __asm__ __volatile__("" ::: "memory");
+    }
+};
+
+#endif // RING_BUFFER_HPP
@@ -3,9 +3,14 @@
 // The only I didn't end up writing
 #include <LiquidCrystal_I2C.h>
 
+#include "lcd_renderer.hpp"
+
 
 // LCD settings
-LiquidCrystal_I2C lcd(0x27, 16, 2);
+LiquidCrystal_I2C lcd(0x27, LCD_COLS, LCD_ROWS);
+
+// Everything is drawn through the renderer, loop() flushes it
+LcdRenderer lcdRenderer(lcd);
 
 class StateWithFloat : public State {
 /**
@@ -14,8 +19,8 @@ class StateWithFloat : public State {
  */
 
 public:
-    StateWithFloat(uint8_t id, FiniteStateAutomaton* automaton, float& externalVar, float minVal, float maxVal)
-        : State(id, automaton), _externalVar(externalVar), _init(externalVar), _min(minVal), _max(maxVal), _hasChanged(false) {
+    StateWithFloat(uint8_t id, float& externalVar, float minVal, float maxVal)
+        : State(id), _externalVar(externalVar), _init(externalVar), _min(minVal), _max(maxVal), _hasChanged(false) {
           _externalVar = min(_externalVar, _max);
           _externalVar = max(_externalVar, _min);
         }
@@ -83,8 +88,8 @@ class StateWithInt : public State {
  */
 
 public:
-    StateWithInt(uint8_t id, FiniteStateAutomaton* automaton, int& externalVar, int minVal, int maxVal)
-        : State(id, automaton), _externalVar(externalVar), _init(externalVar), _min(minVal), _max(maxVal), _hasChanged(false) {
+    StateWithInt(uint8_t id, int& externalVar, int minVal, int maxVal)
+        : State(id), _externalVar(externalVar), _init(externalVar), _min(minVal), _max(maxVal), _hasChanged(false) {
           _externalVar = min(_externalVar, _max);
           _externalVar = max(_externalVar, _min);
         }
@@ -151,8 +156,8 @@ class StateWithBool : public State {
  */
 
 public:
-    StateWithBool(uint8_t id, FiniteStateAutomaton* automaton, bool& externalVar)
-        : State(id, automaton), _externalVar(externalVar), _init(externalVar), _hasChanged(false) {}
+    StateWithBool(uint8_t id, bool& externalVar)
+        : State(id), _externalVar(externalVar), _init(externalVar), _hasChanged(false) {}
 
     void toggle() {
         _externalVar = !_externalVar;
@@ -188,30 +193,33 @@ private:
 
 /* ---------------------------- Utility functions --------------------------- */
 
-String floatToString(float value, int width=6, int decimals=2) {
-    char buffer[20]; // Buffer to hold the string representation
-    dtostrf(value, width, decimals, buffer); // Convert float to string
-    return String(buffer); // Return as String object
+const char* floatToString(float value, const char* unit = "", int width = 6, int decimals = 2) {
+    /**
+     * Format a value followed by its unit. The text lives in a static buffer,
+     * valid until the next call.
+     */
+
+    static char buffer[24];
+    dtostrf(value, width, decimals, buffer);
+    strncat(buffer, unit, sizeof(buffer) - strlen(buffer) - 1);
+    return buffer;
 }
 
-void updateLCD(const String& firstRow, const String& secondRow) {
+void updateLCD(const char* firstRow, const char* secondRow) {
   /**
-  * Updates the display. It only has two rows (2x16).
+  * Updates the display. It only has two rows (2x16). Only the frame in memory
+  * changes here, the cells that differ reach the display on the next flushes.
   */
 
-  // Clear the screen
-  lcd.clear();
-
-  // Print the first row
-  lcd.setCursor(0,0);
-  lcd.print(firstRow);
-
-  // Print the second row
-  lcd.setCursor(0,1);
-  lcd.print(secondRow);
+  lcdRenderer.setRow(0, firstRow);
+  lcdRenderer.setRow(1, secondRow);
 
 }
 
+// Custom glyphs of the progress bar: 1 to 4 columns filled (CGRAM 0-3), then the built-in full block
+const uint8_t PROGRESS_GLYPHS = 4;
+const char PROGRESS_FULL = (char)0xFF;
+
 void setupLCD() {
   /**
   * Setup the LCD.
@@ -220,75 +228,78 @@ void setupLCD() {
   // LCD setup
   lcd.init();
   lcd.backlight();
+
+  // Partial blocks of the progress bar, filled from the left
+  for (uint8_t i = 0; i < PROGRESS_GLYPHS; i++) {
+    uint8_t glyph[8];
+    memset(glyph, (0x1F << (PROGRESS_GLYPHS - i)) & 0x1F, sizeof(glyph));
+    lcd.createChar(i, glyph);
+  }
+
+  lcd.clear();
+  lcdRenderer.reset();
 }
 
-String createProgressBar(int percentage) {
+uint8_t progressBarSteps(int percentage) {
+  /**
+  * Number of pixel columns of the progress bar to fill, 5 per character.
+  */
 
-  // Ensure the percentage is within 0-100
-  if (percentage < 0) percentage = 0;
-  if (percentage > 100) percentage = 100;
+  percentage = constrain(percentage, 0, 100);
+  return (long)percentage * LCD_COLS * 5 / 100;
+}
 
-  // Calculate the number of filled and empty segments
-  int filledLength = (percentage / 100.0) * 16; // 16 characters on the LCD
-  String progressBar = "";
+const char* createProgressBar(uint8_t steps) {
+  /**
+  * Progress bar as wide as the display, filled by the given number of pixel 
+  * columns. The text lives in a static buffer, valid until the next call.
+  */
 
-  // Add filled segments
-  for (int i = 0; i < filledLength; i++) {
-    progressBar += "#"; // Use '#' to represent filled
-  }
+  static char bar[LCD_COLS + 1];
 
-  // Add empty segments
-  for (int i = filledLength; i < 16; i++) {
-    progressBar += " "; // Use space for empty
+  for (uint8_t i = 0; i < LCD_COLS; i++) {
+    uint8_t filled = (steps > i * 5) ? min(steps - i * 5, 5) : 0;
+    if (filled == 0) {
+      bar[i] = ' ';
+    } else if (filled == 5) {
+      bar[i] = PROGRESS_FULL;
+    } else {
+      bar[i] = 8 + filled - 1;    // custom glyph, see LcdRenderer
+    }
   }
+  bar[LCD_COLS] = '\0';
 
-  return progressBar;
+  return bar;
 }
 
 /* --------------------------------- States --------------------------------- */
 
 class StateMenuSplashScreen : public State {
 public:
-    StateMenuSplashScreen(FiniteStateAutomaton* automaton) : State(STATE_MENU_SPLASH_SCREEN, automaton) {}
+    StateMenuSplashScreen() : State(STATE_MENU_SPLASH_SCREEN) {}
     void onEnter() override {
         updateLCD("Coil Winder", "     v1.0.0");
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_TIMEOUT)
-            return automaton->changeState(STATE_WIND);
-        return this;
-    }
 };
 
 class StateWind : public State {
 public:
-    StateWind(FiniteStateAutomaton* automaton) : State(STATE_WIND, automaton) {}
+    StateWind() : State(STATE_WIND) {}
     void onEnter() override {
         updateLCD("Wind", "");
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_UP_PRESS)
-            return automaton->changeState(STATE_UNWIND);
-        if (event == EVENT_DOWN_PRESS)
-            return automaton->changeState(STATE_UNWIND);
-        if (event == EVENT_SELECT_PRESS)
-            return automaton->changeState(STATE_SET_WIRE_DIAMETER);
-        return this;
-    }
 };
 
 class StateSetWireDiameter : public StateWithFloat {
 public:
-    StateSetWireDiameter(FiniteStateAutomaton* automaton, float& externalVar) : 
-        StateWithFloat(STATE_SET_WIRE_DIAMETER, automaton, externalVar, MIN_WIRE_DIAMETER, MAX_WIRE_DIAMETER) {
+    StateSetWireDiameter(float& externalVar) : 
+        StateWithFloat(STATE_SET_WIRE_DIAMETER, externalVar, MIN_WIRE_DIAMETER, MAX_WIRE_DIAMETER) {
         }
     void onEnter() override {
         StateWithFloat::onEnter();
-        updateLCD("Wire diameter:", floatToString(getStateVariable()) + " mm");
+        updateLCD("Wire diameter:", floatToString(getStateVariable(), " mm"));
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_SELECT_PRESS)
-            return automaton->changeState(STATE_SET_SPOOL_LENGTH);
+    void onEvent(const uint8_t& event, uint8_t count) override {
         if (event == EVENT_UP_PRESS) {
             increment(DELTA_WIRE_DIAMETER);
         }
@@ -296,32 +307,28 @@ public:
             decrement(DELTA_WIRE_DIAMETER);
         }
         if (event == EVENT_UP_LONGPRESS) {
-            increment(BIG_DELTA_WIRE_DIAMETER);
+            increment(BIG_DELTA_WIRE_DIAMETER * count);
         }
         if (event == EVENT_DOWN_LONGPRESS) {
-            decrement(BIG_DELTA_WIRE_DIAMETER);
+            decrement(BIG_DELTA_WIRE_DIAMETER * count);
         }
 
         if (hasChanged()) {
-            updateLCD("Wire diameter:", floatToString(getStateVariable()) + " mm");
+            updateLCD("Wire diameter:", floatToString(getStateVariable(), " mm"));
             resetChanged();
         }
-
-        return this;
     }
 };
 
 class StateSetSpoolLength : public StateWithFloat {
 public:
-    StateSetSpoolLength(FiniteStateAutomaton* automaton, float& externalVar) : 
-        StateWithFloat(STATE_SET_SPOOL_LENGTH, automaton, externalVar, MIN_SPOOL_LENGTH, MAX_SPOOL_LENGTH) {}
+    StateSetSpoolLength(float& externalVar) : 
+        StateWithFloat(STATE_SET_SPOOL_LENGTH, externalVar, MIN_SPOOL_LENGTH, MAX_SPOOL_LENGTH) {}
     void onEnter() override {
         StateWithFloat::onEnter();
-        updateLCD("Spool length:", floatToString(getStateVariable()) + " mm");
+        updateLCD("Spool length:", floatToString(getStateVariable(), " mm"));
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_SELECT_PRESS)
-            return automaton->changeState(STATE_SET_SPOOL_DIAMETER);
+    void onEvent(const uint8_t& event, uint8_t count) override {
         if (event == EVENT_UP_PRESS) {
             increment(DELTA_SPOOL_LENGTH);
         }
@@ -329,33 +336,29 @@ public:
             decrement(DELTA_SPOOL_LENGTH);
         }
         if (event == EVENT_UP_LONGPRESS) {
-            increment(BIG_DELTA_SPOOL_LENGTH);
+            increment(BIG_DELTA_SPOOL_LENGTH * count);
         }
         if (event == EVENT_DOWN_LONGPRESS) {
-            decrement(BIG_DELTA_SPOOL_LENGTH);
+            decrement(BIG_DELTA_SPOOL_LENGTH * count);
         }
 
         if (hasChanged()) {
-            updateLCD("Spool length:", floatToString(getStateVariable()) + " mm");
+            updateLCD("Spool length:", floatToString(getStateVariable(), " mm"));
             resetChanged();
         }
-
-        return this;
     }
 };
 
 
 class StateSetSpoolDiameter : public StateWithFloat {
 public:
-    StateSetSpoolDiameter(FiniteStateAutomaton* automaton, float& externalVar) : 
-        StateWithFloat(STATE_SET_SPOOL_DIAMETER, automaton, externalVar, MIN_SPOOL_DIAMETER, MAX_SPOOL_DIAMETER) {}
+    StateSetSpoolDiameter(float& externalVar) : 
+        StateWithFloat(STATE_SET_SPOOL_DIAMETER, externalVar, MIN_SPOOL_DIAMETER, MAX_SPOOL_DIAMETER) {}
     void onEnter() override {
         StateWithFloat::onEnter();
-        updateLCD("Spool diameter:", floatToString(getStateVariable()) + " mm");
+        updateLCD("Spool diameter:", floatToString(getStateVariable(), " mm"));
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_SELECT_PRESS)
-            return automaton->changeState(STATE_SET_LAYER_COUNT);
+    void onEvent(const uint8_t& event, uint8_t count) override {
         if (event == EVENT_UP_PRESS) {
             increment(DELTA_SPOOL_DIAMETER);
         }
@@ -363,32 +366,28 @@ public:
             decrement(DELTA_SPOOL_DIAMETER);
         }
         if (event == EVENT_UP_LONGPRESS) {
-            increment(BIG_DELTA_SPOOL_DIAMETER);
+            increment(BIG_DELTA_SPOOL_DIAMETER * count);
         }
         if (event == EVENT_DOWN_LONGPRESS) {
-            decrement(BIG_DELTA_SPOOL_DIAMETER);
+            decrement(BIG_DELTA_SPOOL_DIAMETER * count);
         }
 
         if (hasChanged()) {
-            updateLCD("Spool diameter:", floatToString(getStateVariable()) + " mm");
+            updateLCD("Spool diameter:", floatToString(getStateVariable(), " mm"));
             resetChanged();
         }
-
-        return this;
     }
 };
 
 class StateSetLayerCount : public StateWithFloat {
 public:
-    StateSetLayerCount(FiniteStateAutomaton* automaton, float& externalVar) : 
-        StateWithFloat(STATE_SET_LAYER_COUNT, automaton, externalVar, MIN_LAYER_COUNT, MAX_LAYER_COUNT) {}
+    StateSetLayerCount(float& externalVar) : 
+        StateWithFloat(STATE_SET_LAYER_COUNT, externalVar, MIN_LAYER_COUNT, MAX_LAYER_COUNT) {}
     void onEnter() override {
         StateWithFloat::onEnter();
         updateLCD("Layer count:", floatToString(getStateVariable()));
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_SELECT_PRESS)
-            return automaton->changeState(STATE_WIND_ASK_CONFIRM);
+    void onEvent(const uint8_t& event, uint8_t count) override {
         if (event == EVENT_UP_PRESS) {
             increment(DELTA_LAYER_COUNT);
         }
@@ -396,94 +395,96 @@ public:
             decrement(DELTA_LAYER_COUNT);
         }
         if (event == EVENT_UP_LONGPRESS) {
-            increment(BIG_DELTA_LAYER_COUNT);
+            increment(BIG_DELTA_LAYER_COUNT * count);
         }
         if (event == EVENT_DOWN_LONGPRESS) {
-            decrement(BIG_DELTA_LAYER_COUNT);
+            decrement(BIG_DELTA_LAYER_COUNT * count);
         }
 
         if (hasChanged()) {
-            updateLCD("Layer count:", floatToString(getStateVariable()) + " mm");
+            updateLCD("Layer count:", floatToString(getStateVariable(), " mm"));
             resetChanged();
         }
-
-        return this;
     }
 };
 
-class StateWindAskConfirm : public State {
+class StateWindAskConfirm : public StateWithInt {
 public:
-    StateWindAskConfirm(FiniteStateAutomaton* automaton) : State(STATE_WIND_ASK_CONFIRM, automaton) {}
+    StateWindAskConfirm(int& externalVar) : StateWithInt(STATE_WIND_ASK_CONFIRM, externalVar, 0, 5) {}
     void onEnter() override {
+        StateWithInt::onEnter();
         updateLCD("Start winding?", "");
-    }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_SELECT_PRESS)
-            return automaton->changeState(STATE_START_WINDING);
-        if (event == EVENT_SELECT_LONGPRESS)
-            return automaton->changeState(STATE_WIND);
-        return this;
+
+        // Set to 5 to have the outside code compile the job while the user confirms
+        set(5);
     }
 };
 
 class StateStartWinding : public StateWithInt {
 public:
-    StateStartWinding(FiniteStateAutomaton* automaton, int& externalVar) : 
-        StateWithInt(STATE_START_WINDING, automaton, externalVar, 0, 2), _progress(0) {}
+    StateStartWinding(int& externalVar, const int& progress, const bool& jobPaused) :
+        StateWithInt(STATE_START_WINDING, externalVar, 0, 4), _progress(progress), _jobPaused(jobPaused), _paused(false), _steps(0) {}
     void onEnter() override {
         StateWithInt::onEnter();
 
         // Update the LCD
         updateLCD("Winding...", "");
 
-        // Reset the progress variable
-        _progress = 0;
+        _paused = false;
+        _steps = 0;
 
         // Set to 1 to signal we can start the procedure to the outside code
         set(1);
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_RESET) {
-            return automaton->changeState(STATE_SET_WIRE_DIAMETER);
+    void onEvent(const uint8_t& event, uint8_t count) override {
+        if (event == EVENT_SELECT_PRESS) {
+            // Ask the outside code to pause or resume the procedure, the screen follows once it does
+            set(3);
+        }
+        if (event == EVENT_SELECT_LONGPRESS) {
+            // Ask the outside code to abort the procedure, it answers with EVENT_RESET
+            set(4);
         }
         if (event == EVENT_UPDATE_PROGRESS) {
-            _progress += 1;
-            updateLCD("Winding...", createProgressBar(_progress));
+            // Only redraw when the bar visibly changes, or the job paused or resumed
+            uint8_t steps = progressBarSteps(_progress);
+            if (steps != _steps || _paused != _jobPaused) {
+                _steps = steps;
+                _paused = _jobPaused;
+                updateLCD(_paused ? "Paused" : "Winding...", createProgressBar(_steps));
+            }
+        }
+        if (event == EVENT_TAP) {
+            // The program stopped at a tap, the next press resumes it
+            _paused = true;
+            _steps = progressBarSteps(_progress);
+            updateLCD("Tap", createProgressBar(_steps));
         }
-        return this;
     }
 private:
-    int _progress;
+    const int& _progress;   // percentage, updated by the outside code
+    const bool& _jobPaused; // pausing or paused, updated by the outside code from the job status
+    bool _paused;           // shown as paused (or stopped at a tap)
+    uint8_t _steps;         // pixel columns of the bar shown
 };
 
 class StateUnwind : public State {
 public:
-    StateUnwind(FiniteStateAutomaton* automaton) : State(STATE_UNWIND, automaton) {}
+    StateUnwind() : State(STATE_UNWIND) {}
     void onEnter() override {
         updateLCD("Unwind", "");
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_UP_PRESS)
-            return automaton->changeState(STATE_WIND);
-        if (event == EVENT_DOWN_PRESS)
-            return automaton->changeState(STATE_WIND);
-        if (event == EVENT_SELECT_PRESS)
-            return automaton->changeState(STATE_SET_TIME);
-        return this;
-    }
 };
 
 class StateSetTime : public StateWithFloat {
 public:
-    StateSetTime(FiniteStateAutomaton* automaton, float& externalVar) :
-        StateWithFloat(STATE_SET_TIME, automaton, externalVar, MIN_TIME, MAX_TIME) {}
+    StateSetTime(float& externalVar) :
+        StateWithFloat(STATE_SET_TIME, externalVar, MIN_TIME, MAX_TIME) {}
     void onEnter() override {
         StateWithFloat::onEnter();
-        updateLCD("Time:", floatToString(getStateVariable()) + " s");
+        updateLCD("Time:", floatToString(getStateVariable(), " s"));
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_SELECT_PRESS)
-            return automaton->changeState(STATE_SET_SPEED);
+    void onEvent(const uint8_t& event, uint8_t count) override {
         if (event == EVENT_UP_PRESS) {
             increment(DELTA_TIME);
         }
@@ -491,32 +492,28 @@ public:
             decrement(DELTA_TIME);
         }
         if (event == EVENT_UP_LONGPRESS) {
-            increment(BIG_DELTA_TIME);
+            increment(BIG_DELTA_TIME * count);
         }
         if (event == EVENT_DOWN_LONGPRESS) {
-            decrement(BIG_DELTA_TIME);
+            decrement(BIG_DELTA_TIME * count);
         }
 
         if (hasChanged()) {
-            updateLCD("Time:", floatToString(getStateVariable()) + " s");
+            updateLCD("Time:", floatToString(getStateVariable(), " s"));
             resetChanged();
         }
-
-        return this;
     }
 };
 
 class StateSetSpeed : public StateWithFloat {
 public:
-    StateSetSpeed(FiniteStateAutomaton* automaton, float& externalVar) :
-        StateWithFloat(STATE_SET_SPEED, automaton, externalVar, MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S) {}
+    StateSetSpeed(float& externalVar) :
+        StateWithFloat(STATE_SET_SPEED, externalVar, MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S) {}
     void onEnter() override {
         StateWithFloat::onEnter();
-        updateLCD("Speed:", floatToString(getStateVariable()) + " steps/s");
+        updateLCD("Speed:", floatToString(getStateVariable(), " steps/s"));
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_SELECT_PRESS)
-            return automaton->changeState(STATE_SET_DIRECTION);
+    void onEvent(const uint8_t& event, uint8_t count) override {
         if (event == EVENT_UP_PRESS) {
             increment(DELTA_SPEED);
         }
@@ -524,30 +521,28 @@ public:
             decrement(DELTA_SPEED);
         }
         if (event == EVENT_UP_LONGPRESS) {
-            increment(BIG_DELTA_SPEED);
+            increment(BIG_DELTA_SPEED * count);
         }
         if (event == EVENT_DOWN_LONGPRESS) {
-            decrement(BIG_DELTA_SPEED);
+            decrement(BIG_DELTA_SPEED * count);
         }
 
         if (hasChanged()) {
-            updateLCD("Speed:", floatToString(getStateVariable()) + " steps/s");
+            updateLCD("Speed:", floatToString(getStateVariable(), " steps/s"));
             resetChanged();
         }
-
-        return this;
     }
 };
 
 class StateSetDirection : public StateWithBool {
 public:
-    StateSetDirection(FiniteStateAutomaton* automaton, bool& externalVar) :
-        StateWithBool(STATE_SET_DIRECTION, automaton, externalVar){}
+    StateSetDirection(bool& externalVar) :
+        StateWithBool(STATE_SET_DIRECTION, externalVar){}
     void onEnter() override {
         StateWithBool::onEnter();
         updateLCD("Direction:", getStateVariable() ? "Forward" : "Backward");
     }
-    State* onEvent(const uint8_t& event) override {
+    void onEvent(const uint8_t& event, uint8_t count) override {
         if (event == EVENT_UP_PRESS) {
             toggle();
         }
@@ -555,60 +550,89 @@ public:
             toggle();
         }
 
-        if (event == EVENT_SELECT_PRESS) {
-            return automaton->changeState(STATE_UNWIND_ASK_CONFIRM);
-        }
-
         if (hasChanged()) {
             updateLCD("Direction:", getStateVariable() ? "Forward" : "Backward");
             resetChanged();
         }
-
-        return this;
     }
 };
 
 class StateUnwindAskConfirm : public State {
 public:
-    StateUnwindAskConfirm(FiniteStateAutomaton* automaton) : State(STATE_UNWIND_ASK_CONFIRM, automaton) {}
+    StateUnwindAskConfirm() : State(STATE_UNWIND_ASK_CONFIRM) {}
     void onEnter() override {
         updateLCD("Start unwinding?", "");
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_SELECT_PRESS)
-            return automaton->changeState(STATE_START_UNWINDING);
-        if (event == EVENT_SELECT_LONGPRESS)
-            return automaton->changeState(STATE_UNWIND);
-        return this;
-    }
 };
 
 class StateStartUnwinding : public StateWithInt {
 public:
-    StateStartUnwinding(FiniteStateAutomaton* automaton, int& externalVar) :
-        StateWithInt(STATE_START_UNWINDING, automaton, externalVar, 0, 2), _progress(0) {}
+    StateStartUnwinding(int& externalVar, const int& progress, const bool& jobPaused) :
+        StateWithInt(STATE_START_UNWINDING, externalVar, 0, 4), _progress(progress), _jobPaused(jobPaused), _paused(false), _steps(0) {}
     void onEnter() override {
         StateWithInt::onEnter();
 
         // Update the LCD
         updateLCD("Unwinding...", "");
 
-        // Reset the progress variable
-        _progress = 0;
+        _paused = false;
+        _steps = 0;
 
         // Set to 2 to signal we can start the procedure to the outside code
         set(2);
     }
-    State* onEvent(const uint8_t& event) override {
-        if (event == EVENT_RESET) {
-            return automaton->changeState(STATE_SET_SPEED);
+    void onEvent(const uint8_t& event, uint8_t count) override {
+        if (event == EVENT_SELECT_PRESS) {
+            // Ask the outside code to pause or resume the procedure, the screen follows once it does
+            set(3);
+        }
+        if (event == EVENT_SELECT_LONGPRESS) {
+            // Ask the outside code to abort the procedure, it answers with EVENT_RESET
+            set(4);
         }
         if (event == EVENT_UPDATE_PROGRESS) {
-            _progress += 1;
-            updateLCD("Unwinding...", createProgressBar(_progress));
+            // Only redraw when the bar visibly changes, or the job paused or resumed
+            uint8_t steps = progressBarSteps(_progress);
+            if (steps != _steps || _paused != _jobPaused) {
+                _steps = steps;
+                _paused = _jobPaused;
+                updateLCD(_paused ? "Paused" : "Unwinding...", createProgressBar(_steps));
+            }
         }
-        return this;
     }
 private:
-    int _progress;
+    const int& _progress;   // percentage, updated by the outside code
+    const bool& _jobPaused; // pausing or paused, updated by the outside code from the job status
+    bool _paused;           // shown as paused (or stopped at a tap)
+    uint8_t _steps;         // pixel columns of the bar shown
 };
+
+/* ------------------------------- Transitions ------------------------------ */
+
+// Menu navigation, every other event is handled by the current state
+constexpr Transition MENU_TRANSITIONS[] = {
+    {STATE_MENU_SPLASH_SCREEN,  EVENT_TIMEOUT,          STATE_WIND},
+
+    {STATE_WIND,                EVENT_UP_PRESS,         STATE_UNWIND},
+    {STATE_WIND,                EVENT_DOWN_PRESS,       STATE_UNWIND},
+    {STATE_WIND,                EVENT_SELECT_PRESS,     STATE_SET_WIRE_DIAMETER},
+    {STATE_SET_WIRE_DIAMETER,   EVENT_SELECT_PRESS,     STATE_SET_SPOOL_LENGTH},
+    {STATE_SET_SPOOL_LENGTH,    EVENT_SELECT_PRESS,     STATE_SET_SPOOL_DIAMETER},
+    {STATE_SET_SPOOL_DIAMETER,  EVENT_SELECT_PRESS,     STATE_SET_LAYER_COUNT},
+    {STATE_SET_LAYER_COUNT,     EVENT_SELECT_PRESS,     STATE_WIND_ASK_CONFIRM},
+    {STATE_WIND_ASK_CONFIRM,    EVENT_SELECT_PRESS,     STATE_START_WINDING},
+    {STATE_WIND_ASK_CONFIRM,    EVENT_SELECT_LONGPRESS, STATE_WIND},
+    {STATE_START_WINDING,       EVENT_RESET,            STATE_SET_WIRE_DIAMETER},
+
+    {STATE_UNWIND,              EVENT_UP_PRESS,         STATE_WIND},
+    {STATE_UNWIND,              EVENT_DOWN_PRESS,       STATE_WIND},
+    {STATE_UNWIND,              EVENT_SELECT_PRESS,     STATE_SET_TIME},
+    {STATE_SET_TIME,            EVENT_SELECT_PRESS,     STATE_SET_SPEED},
+    {STATE_SET_SPEED,           EVENT_SELECT_PRESS,     STATE_SET_DIRECTION},
+    {STATE_SET_DIRECTION,       EVENT_SELECT_PRESS,     STATE_UNWIND_ASK_CONFIRM},
+    {STATE_UNWIND_ASK_CONFIRM,  EVENT_SELECT_PRESS,     STATE_START_UNWINDING},
+    {STATE_UNWIND_ASK_CONFIRM,  EVENT_SELECT_LONGPRESS, STATE_UNWIND},
+    {STATE_START_UNWINDING,     EVENT_RESET,            STATE_SET_SPEED},
+};
+
+typedef TransitionTable<MENU_TRANSITIONS, sizeof(MENU_TRANSITIONS) / sizeof(Transition)> MenuTransitionTable;
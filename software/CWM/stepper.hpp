@@ -1,11 +1,21 @@
 #ifndef STEPPER_MOTOR_HPP
 #define STEPPER_MOTOR_HPP
 
+#include <util/atomic.h>
+
+#include "ramp_table.hpp"
+#include "fastpin.hpp"
 
 class SpeedProfile {
   public:
     virtual void compute(long totalSteps, double initialVelocity, double finalVelocity = 0, double maxVelocity = 0, double acceleration = 0) = 0;
     virtual double update(long currentStep) = 0;
+
+    // Delay before the next step (us), profiles that can compute it directly override this to skip the division
+    virtual unsigned long interval(long currentStep) {
+      double velocity = update(currentStep);
+      return (velocity > 1) ? 1e6 / velocity : 1e6;
+    }
 };
 
 class TrapezoidalSpeedProfile : public SpeedProfile {
@@ -48,6 +58,469 @@ class TrapezoidalSpeedProfile : public SpeedProfile {
     }
 };
 
+class RampSpeedProfile : public SpeedProfile {
+/**
+ * Same trapezoidal profile as TrapezoidalSpeedProfile, but the step interval is 
+ * computed incrementally with the Austin/Eiderman recurrence: 
+ *
+ *   c_n = c_(n-1) - 2 * c_(n-1) / (4n + 1)
+ *
+ * where n is the number of steps it would take to reach the current velocity
+ * from standstill (the sign flips while decelerating). The interval is kept in 16.16 
+ * fixed point, so each step costs one integer division instead of a sqrt and 
+ * a double division. Only compute() uses floating point, once per move.
+ * Intervals are capped at ~32 ms (30 steps/s) so that 2 * c fits 32 bits.
+ * The recurrence needs to see every step: interval() (or update()) must be
+ * called exactly once per step, with increasing step numbers.
+ */
+
+  private:
+    static const uint8_t FRACTION_BITS = 16;
+    static const uint16_t MAX_INTERVAL = 32767;   // us
+
+    long accelSteps, decelStart, totalSteps;
+    long n, finalN;             // ramp index of the current step and of the final velocity
+    uint32_t c;                 // current interval, us in 16.16 fixed point
+    uint32_t cruiseInterval;    // interval at max velocity, us in 16.16 fixed point
+
+    static uint32_t toFixed(double interval) {
+      if (interval > MAX_INTERVAL) {
+        interval = MAX_INTERVAL;
+      }
+      return interval * (1UL << FRACTION_BITS);
+    }
+
+  public:
+    void compute(long _totalSteps, double _initialVelocity, double _finalVelocity = 0, double _maxVelocity = 0, double _acceleration = 0) override {
+      totalSteps = _totalSteps;
+
+      double maxVelocity = _maxVelocity;
+      long decelSteps;
+      accelSteps = abs((maxVelocity * maxVelocity - _initialVelocity * _initialVelocity) / (2 * _acceleration));
+      decelSteps = abs((maxVelocity * maxVelocity - _finalVelocity * _finalVelocity) / (2 * _acceleration));
+
+      // Fallback to triangular profile if necessary
+      if (accelSteps + decelSteps > totalSteps) {
+          maxVelocity = sqrt(_acceleration * totalSteps + 0.5 * (_initialVelocity * _initialVelocity + _finalVelocity * _finalVelocity));
+          accelSteps = abs((maxVelocity * maxVelocity - _initialVelocity * _initialVelocity) / (2 * _acceleration));
+          decelSteps = totalSteps - accelSteps;
+      }
+      decelStart = totalSteps - decelSteps;
+      cruiseInterval = toFixed(1e6 / maxVelocity);
+
+      // Start the recurrence where the initial velocity sits on the ramp
+      n = (_initialVelocity * _initialVelocity) / (2 * _acceleration);
+      finalN = (_finalVelocity * _finalVelocity) / (2 * _acceleration);
+      if (_initialVelocity > 0) {
+        c = toFixed(1e6 / _initialVelocity);
+      } else {
+        // Austin's corrected first delay from standstill
+        c = toFixed(0.676 * sqrt(2.0 / _acceleration) * 1e6);
+      }
+    }
+
+    unsigned long interval(long currentStep) override {
+      if (currentStep < accelSteps) {
+        n++;
+        c -= (2 * c) / (4 * n + 1);
+      } else if (currentStep <= decelStart) {
+        c = cruiseInterval;
+      } else {
+        // Ramp index counting down to the final velocity
+        long m = finalN + (totalSteps - currentStep);
+        if (m > 0) {
+          c += (2 * c) / (4 * m - 1);
+        }
+      }
+      return c >> FRACTION_BITS;
+    }
+
+    double update(long currentStep) override {
+      return 1e6 / interval(currentStep);
+    }
+};
+
+class TableSpeedProfile : public SpeedProfile {
+/**
+ * Trapezoidal profile that walks the precomputed ramp table. The move is 
+ * expressed as positions on the standard ramp: the initial, maximum and final
+ * velocities are converted to ramp indices once in compute(), which also 
+ * allows moves starting or ending mid-ramp. Every step then costs a table
+ * lookup, the flash is only read when the lookup crosses into a new entry.
+ * The ramp is the one of ACCELERATION: the acceleration argument is ignored
+ * and velocities are clamped to [MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S],
+ * use covers() to check whether a move fits the table.
+ */
+
+  private:
+    uint16_t startIndex, peakIndex, endIndex;
+    long accelSteps, decelStart, totalSteps;
+
+    // Cached pair of table entries around the last lookup
+    uint16_t cachedEntry, cachedLow, cachedHigh;
+
+    static uint16_t toIndex(double velocity) {
+      if (velocity <= MIN_VELOCITY_STEPS_S) {
+        return 0;
+      }
+      if (velocity >= MAX_VELOCITY_STEPS_S) {
+        return RAMP_STEPS;
+      }
+      return (velocity * velocity - MIN_VELOCITY_STEPS_S * MIN_VELOCITY_STEPS_S) / (2 * ACCELERATION);
+    }
+
+    uint16_t lookup(uint16_t index) {
+      uint16_t entry = index >> RAMP_TABLE_SHIFT;
+      if (entry != cachedEntry) {
+        cachedEntry = entry;
+        cachedLow = pgm_read_word(&StandardRampTable::intervals[entry]);
+        cachedHigh = pgm_read_word(&StandardRampTable::intervals[entry + 1]);
+      }
+
+      // Intervals decrease along the ramp
+      uint16_t fraction = index & ((1 << RAMP_TABLE_SHIFT) - 1);
+      return cachedLow - (((uint32_t)(cachedLow - cachedHigh) * fraction) >> RAMP_TABLE_SHIFT);
+    }
+
+  public:
+    TableSpeedProfile() : cachedEntry(0xFFFF) {}
+
+    // Check if a trapezoidal move can be taken from the standard ramp
+    static bool covers(double initialVelocity, double maxVelocity, double finalVelocity, double acceleration) {
+      return acceleration == ACCELERATION &&
+             initialVelocity >= MIN_VELOCITY_STEPS_S && finalVelocity >= MIN_VELOCITY_STEPS_S &&
+             maxVelocity <= MAX_VELOCITY_STEPS_S;
+    }
+
+    void compute(long _totalSteps, double _initialVelocity, double _finalVelocity = 0, double _maxVelocity = 0, double _acceleration = 0) override {
+      totalSteps = _totalSteps;
+      startIndex = toIndex(_initialVelocity);
+      peakIndex = toIndex(_maxVelocity);
+      endIndex = toIndex(_finalVelocity);
+      if (startIndex > peakIndex) startIndex = peakIndex;
+      if (endIndex > peakIndex) endIndex = peakIndex;
+
+      accelSteps = peakIndex - startIndex;
+      long decelSteps = peakIndex - endIndex;
+
+      // Fallback to triangular profile if necessary, the peak is wherever the two ramps meet
+      if (accelSteps + decelSteps > totalSteps) {
+        long peak = (totalSteps + startIndex + endIndex) / 2;
+        if (peak < startIndex) peak = startIndex;
+        peakIndex = peak;
+        accelSteps = peakIndex - startIndex;
+        decelSteps = totalSteps - accelSteps;
+      }
+      decelStart = totalSteps - decelSteps;
+    }
+
+    unsigned long interval(long currentStep) override {
+      if (currentStep < accelSteps) {
+        return lookup(startIndex + currentStep);
+      } else if (currentStep <= decelStart) {
+        return lookup(peakIndex);
+      } else {
+        long index = endIndex + (totalSteps - currentStep);
+        return lookup(index < peakIndex ? index : peakIndex);
+      }
+    }
+
+    double update(long currentStep) override {
+      return 1e6 / interval(currentStep);
+    }
+};
+
+class SCurveSpeedProfile : public SpeedProfile {
+/**
+ * Jerk-limited (S-curve) profile: the acceleration ramps up and down at a
+ * constant jerk instead of switching on and off, in 7 phases: jerk up,
+ * constant acceleration, jerk down, cruise, and the same three to brake.
+ * Ramps too small to reach the full acceleration skip the constant part,
+ * moves too short to reach the maximum velocity peak at the highest
+ * velocity that still leaves room to brake (found by bisection). The final
+ * velocity must be reachable within the move.
+ *
+ * compute() works out in floating point the step where each phase ends and
+ * the velocity there. The constant acceleration phases then follow the
+ * same recurrence as RampSpeedProfile (one division per step), while in 
+ * the jerk phases the acceleration and the velocity are integrated over
+ * the previous step interval in fixed point (two multiplications and one
+ * division). The jerk phases are short and the velocity is set back to the
+ * planned one at each phase boundary, so the integration error does not
+ * build up. Below 1e6 / MAX_STEP_TIME steps/s, i.e. on the first steps of
+ * a move from (near) standstill, the interval is too long to integrate
+ * over: there the first phase is solved for the time of each step instead
+ * (v0 t + j t^3 / 6 = steps, a few Newton iterations), which is affordable
+ * at such low rates. When the first phase is shorter than a step, the
+ * first step is timed on the planned ramp instead (bisection on its closed
+ * form) and the constant acceleration recurrence starts from Austin's
+ * first delay.
+ * firstInterval() is the delay before the first step. interval() (or
+ * update()) must be called exactly once per step, with increasing step
+ * numbers.
+ */
+
+  private:
+    static const uint8_t PHASES = 7;
+    static const uint16_t MAX_STEP_TIME = 8191;   // us, longest interval integrated, keeps the products in 32 bits
+    static const uint16_t MAX_INTERVAL = 32767;   // us, so that 2 * fixedC fits 32 bits
+
+    double jerk;
+
+    long phaseEnd[PHASES];                  // step where each phase ends
+    int32_t phaseVelocity[PHASES + 1];      // velocity at the start of each phase, steps/s in 16.16 fixed point
+    int32_t accelPeak, decelPeak;           // acceleration, 2^32 / 1e6 per steps/s^2
+    uint32_t jerkStep;                      // jerk, 2^40 / 1e12 per steps/s^3
+
+    long rampIndex[2];                      // ramp index at the start of the constant acceleration phases
+    uint32_t rampInterval[2];               // and interval there, us in 16.16 fixed point
+
+    uint8_t phase;
+    int32_t velocity, acceleration;         // current, same units as above
+    long n;                                 // ramp index, constant acceleration phases
+    uint32_t fixedC;                        // interval in 16.16 fixed point, constant acceleration phases
+    uint32_t c;                             // current interval, us
+    double startVelocity;                   // steps/s, at the start of the move
+    double stepTime;                        // s, from the start of the move to the last step, while solving
+
+    // Steps taken to go from one velocity to another
+    double rampSteps(double from, double to, double maxAcceleration) {
+      double dv = fabs(to - from);
+      if (dv == 0) {
+        return 0;
+      }
+      double peak = min(maxAcceleration, sqrt(dv * jerk));
+      return (from + to) / 2 * (peak / jerk + dv / peak);
+    }
+
+    // Fill the 3 phases of a ramp starting at phase first and step start, returns the peak acceleration
+    double planRamp(uint8_t first, double start, double from, double to, double maxAcceleration) {
+      double dv = fabs(to - from);
+      double sign = (to >= from) ? 1 : -1;
+      double peak = (dv > 0) ? min(maxAcceleration, sqrt(dv * jerk)) : 0;
+      double tj = (dv > 0) ? peak / jerk : 0;
+      double ta = (dv > 0) ? dv / peak - tj : 0;
+
+      double v1 = from + sign * jerk * tj * tj / 2;
+      double v2 = v1 + sign * peak * ta;
+      double s1 = start + from * tj + sign * jerk * tj * tj * tj / 6;
+      double s2 = s1 + v1 * ta + sign * peak * ta * ta / 2;
+      double s3 = start + rampSteps(from, to, maxAcceleration);
+
+      phaseVelocity[first] = toFixed(from);
+      phaseVelocity[first + 1] = toFixed(v1);
+      phaseVelocity[first + 2] = toFixed(v2);
+      phaseEnd[first] = s1 + 0.5;
+      phaseEnd[first + 1] = s2 + 0.5;
+      phaseEnd[first + 2] = s3 + 0.5;
+
+      // Where the constant acceleration phase sits on the ramp of its acceleration
+      uint8_t ramp = (first == 0) ? 0 : 1;
+      rampIndex[ramp] = (peak > 0) ? v1 * v1 / (2 * peak) : 0;
+      if (rampIndex[ramp] == 0 && peak > 0) {
+        // Jerk phase shorter than a step, Austin's corrected first delay from standstill
+        rampInterval[ramp] = toFixedInterval(0.676 * sqrt(2.0 / peak) * 1e6);
+      } else {
+        rampInterval[ramp] = toFixedInterval((v1 > 0) ? 1e6 / v1 : MAX_INTERVAL);
+      }
+      return peak;
+    }
+
+    static int32_t toFixed(double velocity) {
+      return velocity * 65536.0;
+    }
+
+    static uint32_t toFixedInterval(double interval) {
+      if (interval > MAX_INTERVAL) {
+        interval = MAX_INTERVAL;
+      }
+      return interval * 65536.0;
+    }
+
+    // Time (s) the first phase takes to cover the given number of steps, from standstill or slower than MAX_STEP_TIME
+    double solveStepTime(long steps) {
+      // Both bounds are past the root, from there Newton converges from above
+      double t = cbrt(6.0 * steps / jerk);
+      if (startVelocity > 0) {
+        t = min(t, steps / startVelocity);
+      }
+      for (uint8_t i = 0; i < 6; i++) {
+        t -= (startVelocity * t + jerk * t * t * t / 6 - steps) / (startVelocity + jerk * t * t / 2);
+      }
+      return t;
+    }
+
+    // Steps covered t seconds into a ramp from v0 (jerk up, peak acceleration, jerk down), then at the velocity reached
+    double rampPosition(double t, double v0, double peak, double tj, double ta) {
+      double s = 0, v = v0;
+      double step = min(t, tj);
+      s += v * step + jerk * step * step * step / 6;
+      v += jerk * tj * tj / 2;
+      t -= step;
+      step = min(t, ta);
+      s += v * step + peak * step * step / 2;
+      v += peak * ta;
+      t -= step;
+      step = min(t, tj);
+      s += v * step + peak * step * step / 2 - jerk * step * step * step / 6;
+      v += jerk * tj * tj / 2;
+      t -= step;
+      return s + v * t;
+    }
+
+    // Time (s) of the first step on a ramp from v0 by dv, when the first phase is shorter than a step
+    double firstStepTime(double v0, double peak, double dv) {
+      double tj = peak / jerk;
+      double ta = max(dv / peak - tj, 0.0);
+      double low = 0;
+      double high = 2 * tj + ta + 1 / (v0 + dv);
+      for (uint8_t i = 0; i < 24; i++) {
+        double middle = (low + high) / 2;
+        if (rampPosition(middle, v0, peak, tj, ta) < 1) {
+          low = middle;
+        } else {
+          high = middle;
+        }
+      }
+      return high;
+    }
+
+    // Acceleration at the start of a phase
+    int32_t startAcceleration(uint8_t p) {
+      return (p == 1 || p == 2) ? accelPeak : (p == 5 || p == 6) ? -decelPeak : 0;
+    }
+
+  public:
+    SCurveSpeedProfile() : jerk(JERK) {}
+
+    // Jerk of the next moves (steps/s^3)
+    void setJerk(double _jerk) {
+      jerk = _jerk;
+    }
+
+    void compute(long _totalSteps, double _initialVelocity, double _finalVelocity = 0, double _maxVelocity = 0, double _acceleration = 0) override {
+      double low = max(_initialVelocity, _finalVelocity);
+      double peak = max(_maxVelocity, low);
+
+      // Lower the peak until both ramps fit
+      if (rampSteps(_initialVelocity, peak, _acceleration) + rampSteps(peak, _finalVelocity, _acceleration) > _totalSteps) {
+        double high = peak;
+        peak = low;
+        for (uint8_t i = 0; i < 16; i++) {
+          double middle = (low + high) / 2;
+          if (rampSteps(_initialVelocity, middle, _acceleration) + rampSteps(middle, _finalVelocity, _acceleration) <= _totalSteps) {
+            low = peak = middle;
+          } else {
+            high = middle;
+          }
+        }
+      }
+
+      // Ramp up, cruise, ramp down
+      double decelStart = _totalSteps - rampSteps(peak, _finalVelocity, _acceleration);
+      double accel = planRamp(0, 0, _initialVelocity, peak, _acceleration);
+      double decel = planRamp(4, decelStart, peak, _finalVelocity, _acceleration);
+      phaseVelocity[3] = toFixed(peak);
+      phaseEnd[3] = decelStart + 0.5;
+      phaseVelocity[PHASES] = toFixed(_finalVelocity);
+      phaseEnd[PHASES - 1] = _totalSteps;
+
+      accelPeak = accel * 4294.967296;
+      decelPeak = decel * 4294.967296;
+      jerkStep = jerk * 1.099511627776;
+
+      phase = 0;
+      velocity = phaseVelocity[0];
+      acceleration = 0;
+      startVelocity = _initialVelocity;
+      stepTime = 0;
+      c = MAX_STEP_TIME;
+      bool slow = _initialVelocity <= 0 || 1e6 / _initialVelocity > MAX_STEP_TIME;
+      if (slow && phaseEnd[0] > 0) {
+        stepTime = solveStepTime(1);
+        c = stepTime * 1e6;
+      } else if (slow && accel > 0) {
+        // First phase shorter than a step: time the first step on the planned ramp (never before (6 / j)^(1/3))
+        c = firstStepTime(_initialVelocity, accel, peak - _initialVelocity) * 1e6;
+      } else if (_initialVelocity > 0) {
+        c = 1e6 / _initialVelocity;
+      }
+    }
+
+    // Delay before the first step (us)
+    unsigned long firstInterval() {
+      return c;
+    }
+
+    unsigned long interval(long currentStep) override {
+      while (phase < PHASES - 1 && currentStep >= phaseEnd[phase]) {
+        phase++;
+        velocity = phaseVelocity[phase];
+        acceleration = startAcceleration(phase);
+        if (phase == 1 || phase == 5) {
+          n = rampIndex[phase == 1 ? 0 : 1];
+          fixedC = rampInterval[phase == 1 ? 0 : 1];
+        }
+      }
+
+      // Constant acceleration: c_n = c_(n-1) -/+ 2 * c_(n-1) / (4n +/- 1), fixedC stays below MAX_INTERVAL
+      if (phase == 1) {
+        n++;
+        fixedC -= (2 * fixedC) / (4 * n + 1);
+        c = fixedC >> 16;
+        return c;
+      }
+      if (phase == 5) {
+        if (n > 1) {
+          fixedC += (2 * fixedC) / (4 * n - 1);
+          fixedC = min(fixedC, (uint32_t)MAX_INTERVAL << 16);
+          n--;
+        }
+        c = fixedC >> 16;
+        return c;
+      }
+
+      // Too slow to integrate, time the next step on the first phase
+      if (phase == 0 && c > MAX_STEP_TIME) {
+        double t = solveStepTime(currentStep + 1);
+        c = (t - stepTime) * 1e6;
+        stepTime = t;
+        velocity = toFixed(startVelocity + jerk * t * t / 2);
+        acceleration = min((int32_t)(jerk * t * 4294.967296), accelPeak);
+        return c;
+      }
+
+      uint16_t dt = min(c, (uint32_t)MAX_STEP_TIME);
+
+      // Jerk phases: up, down, down, up (0, 2, 4, 6)
+      if (phase != 3 && !(phase & 1)) {
+        uint32_t change = (jerkStep * dt) >> 8;
+        if (phase == 0 || phase == 6) {
+          acceleration += change;
+        } else {
+          acceleration -= change;
+        }
+        acceleration = constrain(acceleration, phase < 3 ? 0 : -decelPeak, phase < 3 ? accelPeak : 0);
+      }
+
+      uint32_t change = ((uint32_t)(abs(acceleration) >> 8) * dt) >> 8;
+      velocity += (acceleration >= 0) ? (int32_t)change : -(int32_t)change;
+
+      // Stay between the velocities the phase starts and ends at
+      int32_t from = phaseVelocity[phase];
+      int32_t to = phaseVelocity[phase + 1];
+      velocity = constrain(velocity, min(from, to), max(from, to));
+
+      // Below 1 step/s only when starting from standstill
+      c = 256000000UL / (uint32_t)max(velocity >> 8, (int32_t)256);
+      return c;
+    }
+
+    double update(long currentStep) override {
+      return 1e6 / interval(currentStep);
+    }
+};
+
 class LinearSpeedProfile : public SpeedProfile {
   private:
     double initialVelocity, finalVelocity, increment;
@@ -98,26 +571,37 @@ class StepperMotor {
     bool direction;
     
     // Velocity
-    unsigned long stepInterval, lastStepTime;
-    double currentVelocity;
+    unsigned long stepInterval;
     
     // Speed profile
     SpeedProfile* speedProfile; // Pointer to current speed profile
-    TrapezoidalSpeedProfile trapezoidalProfile;
+    RampSpeedProfile rampProfile;
+    TableSpeedProfile tableProfile;
     LinearSpeedProfile linearProfile;
     ConstantSpeedProfile constantProfile;
+    static SCurveSpeedProfile sCurveProfile;    // shared, one S-curve move at a time
+    static StepperMotor* sCurveOwner;           // motor the S-curve move was last given to
     
-    void initializeMove(long _targetPosition, double _initialVelocity) {
+    void setTarget(long _targetPosition) {
         targetPosition = _targetPosition;
         currentStep = 0;
         
         totalSteps = abs(targetPosition - currentPosition);
         direction = (targetPosition > currentPosition) ? HIGH : LOW;
-        digitalWrite(dirPin, direction);
+        writeDirection(direction);
+    }
+
+    void initializeMove(long _targetPosition, double _initialVelocity) {
+        setTarget(_targetPosition);
         
-        // Set initial delay
-        stepInterval = 1e6 / _initialVelocity;
-        lastStepTime = micros();
+        // Set initial delay, the step engine waits this long before the first pulse (1 s from standstill)
+        stepInterval = (_initialVelocity > 1) ? 1e6 / _initialVelocity : 1e6;
+    }
+
+  protected:
+    // Drive the direction pin
+    virtual void writeDirection(bool _direction) {
+        digitalWrite(dirPin, _direction);
     }
 
   public:
@@ -125,9 +609,8 @@ class StepperMotor {
     StepperMotor(uint8_t _pulPin, uint8_t _dirPin) : 
         pulPin(_pulPin), dirPin(_dirPin),
         currentPosition(0), targetPosition(0),
-        currentVelocity(0),
         totalSteps(0), currentStep(0),
-        stepInterval(0), lastStepTime(0), 
+        stepInterval(0), 
         speedProfile(nullptr),
         direction(true) 
     {
@@ -135,11 +618,6 @@ class StepperMotor {
         pinMode(dirPin, OUTPUT);
     }
 
-    // Check if the stepper has reached the target position
-    bool isAtTarget() {
-        return currentPosition == targetPosition;
-    }
-
     // Constant speed profile
     void moveToPosition(long _targetPosition, double _initialVelocity) {
       speedProfile = &constantProfile;
@@ -154,55 +632,183 @@ class StepperMotor {
       speedProfile->compute(totalSteps, _initialVelocity, _finalVelocity);
     }
     
-    // Trapezoidal speed profile
+    // Trapezoidal speed profile (tabulated for the standard ramp, fixed point otherwise)
     void moveToPosition(long _targetPosition, double _initialVelocity, double _maxVelocity, double _finalVelocity, double _acceleration) {
-      speedProfile = &trapezoidalProfile;
+      if (TableSpeedProfile::covers(_initialVelocity, _maxVelocity, _finalVelocity, _acceleration)) {
+        speedProfile = &tableProfile;
+      } else {
+        speedProfile = &rampProfile;
+      }
       initializeMove(_targetPosition, _initialVelocity);
       speedProfile->compute(totalSteps, _initialVelocity, _finalVelocity, _maxVelocity, _acceleration);
     }
 
-    // Perform a step and print current velocity
-    void step() {
-        
-        unsigned long currentTime = micros();
-        unsigned long elapsedTime = currentTime - lastStepTime;
+    // Jerk-limited S-curve speed profile, refused (false, nothing changes) while another motor runs one
+    bool moveToPosition(long _targetPosition, double _initialVelocity, double _maxVelocity, double _finalVelocity, double _acceleration, double _jerk) {
+      if (sCurveOwner != nullptr && sCurveOwner != this && sCurveOwner->isRunningSCurve()) {
+        return false;
+      }
+      sCurveOwner = this;
+      speedProfile = &sCurveProfile;
+      initializeMove(_targetPosition, _initialVelocity);
+      sCurveProfile.setJerk(_jerk);
+      speedProfile->compute(totalSteps, _initialVelocity, _finalVelocity, _maxVelocity, _acceleration);
+      stepInterval = sCurveProfile.firstInterval();
+      return true;
+    }
 
-        if (currentPosition != targetPosition && elapsedTime >= stepInterval) {
+    // Check if the motor is still on its S-curve move
+    bool isRunningSCurve() {
+      bool running;
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        running = speedProfile == &sCurveProfile && currentPosition != targetPosition;
+      }
+      return running;
+    }
+
+    // Move with a profile computed elsewhere, the profile must outlive the move
+    void moveWithProfile(long _targetPosition, SpeedProfile* _speedProfile, unsigned long _firstInterval) {
+      speedProfile = _speedProfile;
+      setTarget(_targetPosition);
+      stepInterval = _firstInterval;
+    }
 
-            currentPosition += (direction == HIGH) ? 1 : -1;
-            currentStep ++;
-            
-            if (speedProfile) {
-                currentVelocity = speedProfile->update(currentStep);
-                stepInterval = 1e6 / currentVelocity;
-            }
+    // Follow another motor: no speed profile, the step engine decides when each step happens
+    void followTo(long _targetPosition) {
+      speedProfile = nullptr;
+      setTarget(_targetPosition);
+    }
+
+    /**
+     * The following methods are meant to be called by the StepEngine from 
+     * the timer ISR, the motor itself never decides when to step.
+     */
+
+    // Step pin port register and bit, so that the engine can raise several pins at once (nullptr if unknown)
+    virtual volatile uint8_t* stepPort() {
+        return nullptr;
+    }
+
+    virtual uint8_t stepMask() {
+        return 0;
+    }
 
-            // Update the last step time
-            lastStepTime = currentTime;
+    // Raise and lower the step pin
+    virtual void stepHigh() {
+        digitalWrite(pulPin, HIGH);
+    }
+
+    virtual void stepLow() {
+        digitalWrite(pulPin, LOW);
+    }
+
+    // Account for the pulse just emitted and return the delay before the next one (us), 0 when done
+    unsigned long advance() {
+        currentPosition += (direction == HIGH) ? 1 : -1;
+        currentStep ++;
+
+        if (currentPosition == targetPosition) {
+            return 0;
+        }
+
+        if (speedProfile) {
+            stepInterval = speedProfile->interval(currentStep);
+        }
+
+        return stepInterval;
+    }
+
+    // Delay before the first pulse of the current move (us)
+    unsigned long getStepInterval() {
+        return stepInterval;
+    }
 
-            digitalWrite(pulPin, HIGH);
-            delayMicroseconds(1);
-            digitalWrite(pulPin, LOW);
+    // Drop the remaining part of the current move
+    void stop() {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            targetPosition = currentPosition;
         }
     }
 
-    // Set current position manually
+    // Set current position manually (the motor is considered at target afterwards)
     void setCurrentPosition(long _currentPosition) {
-        currentPosition = _currentPosition;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            currentPosition = _currentPosition;
+            targetPosition = _currentPosition;
+        }
+    }
+
+    // Check if the stepper has reached the target position
+    bool isAtTarget() {
+        bool atTarget;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            atTarget = currentPosition == targetPosition;
+        }
+        return atTarget;
     }
 
     // Get current position
     long getCurrentPosition() {
-        return currentPosition;
+        long position;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            position = currentPosition;
+        }
+        return position;
     }
 
     long getTargetPosition() {
         return targetPosition;
     }
 
-    // Get current velocity
+    // Get the number of steps of the current move
+    long getTotalSteps() {
+        return totalSteps;
+    }
+
+    // Get current velocity (derived from the step interval, off the step path)
     double getCurrentVelocity() {
-        return currentVelocity;
+        unsigned long interval;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            interval = stepInterval;
+        }
+        return (interval > 0) ? 1e6 / interval : 0;
+    }
+};
+
+SCurveSpeedProfile StepperMotor::sCurveProfile;
+StepperMotor* StepperMotor::sCurveOwner = nullptr;
+
+template<uint8_t STEP_PIN, uint8_t DIR_PIN>
+class FastStepperMotor : public StepperMotor {
+/**
+ * StepperMotor whose pins are known at compile time: the step pulse and the
+ * direction change go straight to the port registers through FastPin.
+ */
+
+  protected:
+    void writeDirection(bool _direction) override {
+        FastPin<DIR_PIN>::write(_direction);
+    }
+
+  public:
+    FastStepperMotor() : StepperMotor(STEP_PIN, DIR_PIN) {}
+
+#if defined(__AVR_ATmega328P__)
+    volatile uint8_t* stepPort() override {
+        return &FastPin<STEP_PIN>::port();
+    }
+
+    uint8_t stepMask() override {
+        return FastPin<STEP_PIN>::MASK;
+    }
+#endif
+
+    void stepHigh() override {
+        FastPin<STEP_PIN>::high();
+    }
+
+    void stepLow() override {
+        FastPin<STEP_PIN>::low();
     }
 };
 
@@ -0,0 +1,141 @@
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+
+#include <Arduino.h>
+
+#include "config.hpp"
+
+/**
+ * Binary telemetry frame, little-endian:
+ *
+ *   0xA5 0x5A | seq (2) | time ms (4) | position coil, feeder (4 + 4) |
+ *   velocity coil, feeder (2 + 2, signed steps/s) | state (1) | CRC (2)
+ *
+ * The CRC is CRC-16/CCITT-FALSE over everything between the sync bytes and
+ * the CRC itself. Frames share the port with the text log: a reader looks
+ * for the sync bytes and keeps only the frames whose CRC matches.
+ */
+
+const uint8_t TELEMETRY_SYNC_0 = 0xA5;
+const uint8_t TELEMETRY_SYNC_1 = 0x5A;
+const uint8_t TELEMETRY_FRAME_SIZE = 23;
+
+struct TelemetrySample {
+    uint32_t time;              // ms
+    int32_t position[2];        // steps
+    int16_t velocity[2];        // steps/s
+    uint8_t state;              // id of the current state of the automaton
+};
+
+uint16_t telemetryCrc(const uint8_t* data, uint8_t size) {
+    uint16_t crc = 0xFFFF;
+    while (size--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void telemetryPut(uint8_t*& p, uint32_t value, uint8_t size) {
+    while (size--) {
+        *p++ = value & 0xFF;
+        value >>= 8;
+    }
+}
+
+uint32_t telemetryGet(const uint8_t*& p, uint8_t size) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < size; i++) {
+        value |= (uint32_t)(*p++) << (8 * i);
+    }
+    return value;
+}
+
+// Write a whole frame into buffer (TELEMETRY_FRAME_SIZE bytes)
+void encodeTelemetryFrame(const TelemetrySample& sample, uint16_t sequence, uint8_t* buffer) {
+    uint8_t* p = buffer;
+    *p++ = TELEMETRY_SYNC_0;
+    *p++ = TELEMETRY_SYNC_1;
+    telemetryPut(p, sequence, 2);
+    telemetryPut(p, sample.time, 4);
+    telemetryPut(p, sample.position[0], 4);
+    telemetryPut(p, sample.position[1], 4);
+    telemetryPut(p, (uint16_t)sample.velocity[0], 2);
+    telemetryPut(p, (uint16_t)sample.velocity[1], 2);
+    telemetryPut(p, sample.state, 1);
+    telemetryPut(p, telemetryCrc(buffer + 2, p - buffer - 2), 2);
+}
+
+// Read a frame back, false if the sync bytes or the CRC do not match
+bool decodeTelemetryFrame(const uint8_t* buffer, TelemetrySample& sample, uint16_t& sequence) {
+    if (buffer[0] != TELEMETRY_SYNC_0 || buffer[1] != TELEMETRY_SYNC_1) {
+        return false;
+    }
+    const uint8_t* p = buffer + TELEMETRY_FRAME_SIZE - 2;
+    if (telemetryGet(p, 2) != telemetryCrc(buffer + 2, TELEMETRY_FRAME_SIZE - 4)) {
+        return false;
+    }
+
+    p = buffer + 2;
+    sequence = telemetryGet(p, 2);
+    sample.time = telemetryGet(p, 4);
+    sample.position[0] = telemetryGet(p, 4);
+    sample.position[1] = telemetryGet(p, 4);
+    sample.velocity[0] = telemetryGet(p, 2);
+    sample.velocity[1] = telemetryGet(p, 2);
+    sample.state = telemetryGet(p, 1);
+    return true;
+}
+
+class Telemetry {
+/**
+ * Sends a telemetry frame every TELEMETRY_PERIOD_MS. Frames are double
+ * buffered: a new sample is encoded into the free buffer while the other
+ * one waits for the port, and a frame is only written when the serial TX
+ * buffer can take all of it, so neither the sampling nor the frames ever
+ * wait on the UART (nor end up cut by the text log). If the port falls
+ * behind, the waiting frame is replaced by the newer one and the gap shows
+ * up in the sequence numbers.
+ */
+
+public:
+    Telemetry() : pending(NONE), sequence(0), lastSample(0) {}
+
+    // Check if it's time for the next sample
+    bool isDue() {
+        return millis() - lastSample >= TELEMETRY_PERIOD_MS;
+    }
+
+    // Encode a sample, it replaces the frame waiting for the port if there is one
+    void sample(const TelemetrySample& sample) {
+        lastSample += TELEMETRY_PERIOD_MS;
+        if (millis() - lastSample >= TELEMETRY_PERIOD_MS) {
+            // Too far behind, don't try to catch up
+            lastSample = millis();
+        }
+
+        uint8_t free = (pending == 0) ? 1 : 0;
+        encodeTelemetryFrame(sample, sequence++, frames[free]);
+        pending = free;
+    }
+
+    // Write the waiting frame if the port has room for it, call it from loop()
+    void send() {
+        if (pending != NONE && Serial.availableForWrite() >= TELEMETRY_FRAME_SIZE) {
+            Serial.write(frames[pending], TELEMETRY_FRAME_SIZE);
+            pending = NONE;
+        }
+    }
+
+private:
+    static const uint8_t NONE = 0xFF;
+
+    uint8_t frames[2][TELEMETRY_FRAME_SIZE];
+    uint8_t pending;            // frame waiting for the port
+    uint16_t sequence;
+    unsigned long lastSample;   // ms
+};
+
+#endif // TELEMETRY_HPP
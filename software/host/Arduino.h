@@ -0,0 +1,270 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/**
+ * Host stand-in for the Arduino core, enough to build the CWM sketch as a 
+ * native executable. Time is virtual: it only moves forward when the sketch
+ * calls into the core (millis, digitalRead, delay, ...) or through hal::advance,
+ * and Timer1 is emulated on that clock so the step ISR fires at the exact 
+ * virtual time it would on the board, as does the pin change interrupt of
+ * PORTB when an input changes. Every pin edge is recorded.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <type_traits>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define PI 3.1415926535897932384626433832795
+
+#define _BV(bit) (1 << (bit))
+
+template<typename A, typename B>
+inline typename std::common_type<A, B>::type min(A a, B b) {
+    return a < b ? a : b;
+}
+
+template<typename A, typename B>
+inline typename std::common_type<A, B>::type max(A a, B b) {
+    return a < b ? b : a;
+}
+
+template<typename T, typename L, typename H>
+inline T constrain(T value, L low, H high) {
+    return value < low ? low : (value > high ? high : value);
+}
+
+/* ---------------------------------- Flash --------------------------------- */
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_dword(address) (*(const uint32_t*)(address))
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define memcpy_P memcpy
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+/* ---------------------------------- Core ---------------------------------- */
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void noInterrupts();
+void interrupts();
+#define cli() noInterrupts()
+#define sei() interrupts()
+
+char* dtostrf(double value, signed char width, unsigned char precision, char* buffer);
+
+/* --------------------------------- Timer1 --------------------------------- */
+
+// Only the bits the sketch uses, in the positions of the ATmega328P
+#define WGM12 3
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define OCIE1A 1
+#define OCF1A 1
+
+class Timer1Counter {
+public:
+    operator uint16_t() const;
+    Timer1Counter& operator=(uint16_t value);
+};
+
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t OCR1A;
+extern Timer1Counter TCNT1;
+
+// Interrupt handlers are plain functions, the HAL calls the ones that are defined
+#define ISR(vector) void vector()
+void TIMER1_COMPA_vect() __attribute__((weak));
+
+/* --------------------------- Pin change interrupts ------------------------ */
+
+// PCINT0-5 are the pins 8-13 (PORTB), the only group the sketch uses
+#define PCIE0 0
+
+extern volatile uint8_t PCICR, PCMSK0;
+
+// Level of the PORTB pins, reading it is a single instruction on the board so it costs no time
+class PortInput {
+public:
+    explicit PortInput(uint8_t _first) : first(_first) {}
+    operator uint8_t() const;
+private:
+    uint8_t first;
+};
+
+extern PortInput PINB;
+
+void PCINT0_vect() __attribute__((weak));
+
+/* --------------------------------- String --------------------------------- */
+
+class String {
+public:
+    String(const char* value = "") : data(value ? value : "") {}
+    String(const std::string& value) : data(value) {}
+    String(const __FlashStringHelper* value) : data(reinterpret_cast<const char*>(value)) {}
+    String(char value) : data(1, value) {}
+    String(int value, unsigned char base = 10) : data(format((long)value, base)) {}
+    String(unsigned int value, unsigned char base = 10) : data(format((unsigned long)value, base)) {}
+    String(long value, unsigned char base = 10) : data(format(value, base)) {}
+    String(unsigned long value, unsigned char base = 10) : data(format(value, base)) {}
+    String(float value, unsigned char decimals = 2) : data(format((double)value, decimals)) {}
+    String(double value, unsigned char decimals = 2) : data(format(value, decimals)) {}
+
+    unsigned int length() const { return data.length(); }
+    const char* c_str() const { return data.c_str(); }
+    char charAt(unsigned int index) const { return index < data.length() ? data[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    String substring(unsigned int from) const { return substring(from, length()); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) { unsigned int t = from; from = to; to = t; }
+        if (from >= length()) return String();
+        return String(data.substr(from, to - from));
+    }
+
+    int indexOf(char c) const {
+        size_t position = data.find(c);
+        return position == std::string::npos ? -1 : (int)position;
+    }
+
+    String& operator+=(const String& other) { data += other.data; return *this; }
+    String& operator+=(const char* other) { data += other; return *this; }
+    String& operator+=(char other) { data += other; return *this; }
+
+    friend String operator+(const String& a, const String& b) { return String(a.data + b.data); }
+    friend String operator+(const String& a, const char* b) { return String(a.data + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b.data); }
+
+    bool operator==(const String& other) const { return data == other.data; }
+    bool operator==(const char* other) const { return data == other; }
+    bool operator!=(const String& other) const { return data != other.data; }
+
+private:
+    std::string data;
+
+    static std::string format(long value, unsigned char base);
+    static std::string format(unsigned long value, unsigned char base);
+    static std::string format(double value, unsigned char decimals);
+};
+
+/* ---------------------------------- Print --------------------------------- */
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String& text) { return write(text.c_str()); }
+    size_t print(const __FlashStringHelper* text) { return write(reinterpret_cast<const char*>(text)); }
+    size_t print(char value) { return write((uint8_t)value); }
+    size_t print(int value, int base = DEC) { return print(String(value, base)); }
+    size_t print(unsigned int value, int base = DEC) { return print(String(value, base)); }
+    size_t print(long value, int base = DEC) { return print(String(value, base)); }
+    size_t print(unsigned long value, int base = DEC) { return print(String(value, base)); }
+    size_t print(double value, int decimals = 2) { return print(String(value, decimals)); }
+
+    size_t println() { return write("\r\n"); }
+    template<typename T>
+    size_t println(T value) { size_t n = print(value); return n + println(); }
+    template<typename T>
+    size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+};
+
+/* --------------------------------- Serial --------------------------------- */
+
+class HardwareSerial : public Print {
+/**
+ * Transmission is modeled at the configured baud rate with the 64 byte 
+ * buffer of the AVR core: writes only block (advancing the virtual clock) 
+ * when the buffer is full. Received bytes are injected with hal::serialInput.
+ */
+
+public:
+    void begin(unsigned long baud);
+    void end() {}
+    int available();
+    int peek();
+    int read();
+    int availableForWrite();
+    void flush();
+    size_t write(uint8_t value) override;
+    using Print::write;
+    operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+/* ------------------------------ Host controls ----------------------------- */
+
+namespace hal {
+
+    // Virtual time since start (ns)
+    uint64_t nanos();
+
+    // Let time pass, firing the interrupts that become due (if enabled)
+    void advance(uint64_t ns);
+
+    // Drive an input pin from the outside (a button, a switch...), now or at a given virtual time (ns)
+    void setInput(uint8_t pin, uint8_t level);
+    void scheduleInput(uint64_t time, uint8_t pin, uint8_t level);
+
+    // Called on every pin edge written by the sketch
+    void onPinChange(void (*callback)(uint8_t pin, uint8_t level));
+
+    // Bytes the sketch will read from Serial
+    void serialInput(const uint8_t* data, size_t size);
+
+    // Where the sketch Serial output goes (stdout by default)
+    void serialOutput(FILE* file);
+
+    // Record every pin edge (time in ns, pin, level), written as CSV by writeEdges
+    struct Edge {
+        uint64_t time;
+        uint8_t pin;
+        uint8_t level;
+    };
+    void recordEdges(bool enabled);
+    size_t edgeCount();
+    const Edge& edge(size_t index);
+    void clearEdges();
+    void writeEdges(FILE* file);
+
+}
+
+#endif // HOST_ARDUINO_H
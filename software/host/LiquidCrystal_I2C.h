@@ -0,0 +1,124 @@
+#ifndef HOST_LIQUID_CRYSTAL_I2C_H
+#define HOST_LIQUID_CRYSTAL_I2C_H
+
+#include <Arduino.h>
+
+class LiquidCrystal_I2C : public Print {
+/**
+ * Host stand-in for the I2C character LCD. The display content is kept in
+ * memory and every transfer costs the virtual time it takes on the bus
+ * (PCF8574 backpack at 100 kHz, 4-bit mode). With a trace file set, 
+ * traceIfChanged() prints the whole screen there when it changed, custom
+ * glyphs as their digit and the full block (0xFF) as '#'.
+ */
+
+public:
+    static const uint8_t MAX_COLS = 20;
+    static const uint8_t MAX_ROWS = 4;
+
+    // Bus time of one data/command byte and of the clear/home commands (ns)
+    static const uint64_t BYTE_NS = 250000;
+    static const uint64_t CLEAR_NS = 2000000;
+
+    LiquidCrystal_I2C(uint8_t address, uint8_t _cols, uint8_t _rows)
+        : cols(min(_cols, MAX_COLS)), rows(min(_rows, MAX_ROWS)), col(0), row(0), bytes(0) {
+        (void)address;
+        fill();
+        memcpy(traced, screen, sizeof(screen));
+    }
+
+    void init() { fill(); }
+    void begin() { fill(); }
+    void backlight() {}
+    void noBacklight() {}
+    void display() {}
+    void noDisplay() {}
+
+    void clear() {
+        hal::advance(CLEAR_NS);
+        bytes++;
+        fill();
+        col = row = 0;
+    }
+
+    void home() {
+        hal::advance(CLEAR_NS);
+        bytes++;
+        col = row = 0;
+    }
+
+    void setCursor(uint8_t _col, uint8_t _row) {
+        hal::advance(BYTE_NS);
+        bytes++;
+        col = _col;
+        row = _row < rows ? _row : rows - 1;
+    }
+
+    void createChar(uint8_t location, const uint8_t charmap[]) {
+        hal::advance(9 * BYTE_NS);
+        bytes += 9;
+        memcpy(glyphs[location & 0x07], charmap, 8);
+    }
+
+    size_t write(uint8_t value) override {
+        hal::advance(BYTE_NS);
+        bytes++;
+        if (col < cols) {
+            // 8-15 are the custom glyphs again, like on the HD44780
+            screen[row][col] = (value >= 8 && value < 16) ? value - 8 : value;
+        }
+        col++;
+        return 1;
+    }
+    using Print::write;
+
+    // Character currently shown at a position (custom glyphs are 0-7)
+    uint8_t charAt(uint8_t _col, uint8_t _row) const {
+        return screen[_row][_col];
+    }
+
+    // Number of bytes sent to the display so far
+    unsigned long getBytes() const {
+        return bytes;
+    }
+
+    static void setTrace(FILE* file) {
+        traceFile() = file;
+    }
+
+    void traceIfChanged() {
+        FILE* file = traceFile();
+        if (!file || memcmp(traced, screen, sizeof(screen)) == 0) {
+            return;
+        }
+        memcpy(traced, screen, sizeof(screen));
+        fprintf(file, "[lcd %10.3f ms]", hal::nanos() / 1e6);
+        for (uint8_t r = 0; r < rows; r++) {
+            fputs(" |", file);
+            for (uint8_t c = 0; c < cols; c++) {
+                uint8_t value = screen[r][c];
+                fputc(value < 8 ? '0' + value : (value == 0xFF ? '#' : value), file);
+            }
+            fputc('|', file);
+        }
+        fputc('\n', file);
+    }
+
+private:
+    uint8_t cols, rows, col, row;
+    uint8_t screen[MAX_ROWS][MAX_COLS];
+    uint8_t traced[MAX_ROWS][MAX_COLS];
+    uint8_t glyphs[8][8];
+    unsigned long bytes;
+
+    static FILE*& traceFile() {
+        static FILE* file = nullptr;
+        return file;
+    }
+
+    void fill() {
+        memset(screen, ' ', sizeof(screen));
+    }
+};
+
+#endif // HOST_LIQUID_CRYSTAL_I2C_H
@@ -0,0 +1,194 @@
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "stepper.hpp"
+#include "engine.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/**
+ * Step path microbenchmarks, run natively on top of the host HAL. Results are
+ * printed as CSV (benchmark,metric,value,unit) so that runs can be compared
+ * mechanically after touching stepper.hpp or engine.hpp:
+ *
+ *   - host cycles per SpeedProfile::update() and ::interval() for every profile
+ *   - host cycles per StepperMotor::advance(), the per-step work of the motor
+ *   - host cycles per step of the whole engine (ISR included), the number
+ *     that tracks the cost of the step path
+ *   - highest step rate the timer scheduling reproduces within 1% on the
+ *     virtual clock, single axis and dual axis. Only the emulated pin I/O
+ *     cost and MIN_STEP_TIMER_TICKS bound it, the ISR computation is free
+ *     there: it shows pulses being dropped or merged, not a slower ISR
+ *
+ * Cycle counts come from the TSC on x86 and are nanoseconds elsewhere.
+ */
+
+static const long PROFILE_STEPS = 20000;
+static const int REPEAT = 20;
+
+#if defined(__x86_64__) || defined(__i386__)
+static const char* CYCLE_UNIT = "cycles";
+static uint64_t cycles() {
+    return __rdtsc();
+}
+#else
+static const char* CYCLE_UNIT = "ns";
+static uint64_t cycles() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+#endif
+
+static void report(const char* benchmark, const char* metric, double value, const char* unit) {
+    printf("%s,%s,%.2f,%s\n", benchmark, metric, value, unit);
+}
+
+// Keep the compiler from dropping the computed results
+static volatile unsigned long sink;
+
+/* -------------------------------- Profiles -------------------------------- */
+
+static void benchProfile(const char* name, SpeedProfile& profile) {
+    uint64_t best = ~0ULL;
+    for (int r = 0; r < REPEAT; r++) {
+        profile.compute(PROFILE_STEPS, MIN_VELOCITY_STEPS_S, MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S, ACCELERATION);
+        double sum = 0;
+        uint64_t start = cycles();
+        for (long i = 1; i < PROFILE_STEPS; i++) {
+            sum += profile.update(i);
+        }
+        uint64_t elapsed = cycles() - start;
+        sink = sum;
+        best = min(best, elapsed);
+    }
+    report(name, "update", (double)best / PROFILE_STEPS, CYCLE_UNIT);
+
+    best = ~0ULL;
+    for (int r = 0; r < REPEAT; r++) {
+        profile.compute(PROFILE_STEPS, MIN_VELOCITY_STEPS_S, MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S, ACCELERATION);
+        unsigned long sum = 0;
+        uint64_t start = cycles();
+        for (long i = 1; i < PROFILE_STEPS; i++) {
+            sum += profile.interval(i);
+        }
+        uint64_t elapsed = cycles() - start;
+        sink = sum;
+        best = min(best, elapsed);
+    }
+    report(name, "interval", (double)best / PROFILE_STEPS, CYCLE_UNIT);
+}
+
+/* ---------------------------------- Motor --------------------------------- */
+
+enum MoveKind { CONSTANT, LINEAR, TRAPEZOIDAL };
+
+static void startMove(StepperMotor& motor, MoveKind kind, long target) {
+    switch (kind) {
+        case CONSTANT:
+            motor.moveToPosition(target, MAX_VELOCITY_STEPS_S);
+            break;
+        case LINEAR:
+            motor.moveToPosition(target, MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S);
+            break;
+        case TRAPEZOIDAL:
+            motor.moveToPosition(target, MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S, MIN_VELOCITY_STEPS_S, ACCELERATION);
+            break;
+    }
+}
+
+static void benchAdvance(const char* name, MoveKind kind) {
+    StepperMotor motor(STEPPER_1_STEP_PIN, STEPPER_1_DIR_PIN);
+    uint64_t best = ~0ULL;
+    for (int r = 0; r < REPEAT; r++) {
+        motor.setCurrentPosition(0);
+        startMove(motor, kind, PROFILE_STEPS);
+        unsigned long sum = 0;
+        uint64_t start = cycles();
+        for (long i = 0; i < PROFILE_STEPS; i++) {
+            sum += motor.advance();
+        }
+        uint64_t elapsed = cycles() - start;
+        sink = sum;
+        best = min(best, elapsed);
+    }
+    report(name, "advance", (double)best / PROFILE_STEPS, CYCLE_UNIT);
+}
+
+/* --------------------------------- Engine --------------------------------- */
+
+// Run the engine until it is done, return the virtual time it took (ns)
+static uint64_t runEngine() {
+    uint64_t start = hal::nanos();
+    while (stepEngine.isRunning()) {
+        hal::advance(100000);
+    }
+    return hal::nanos() - start;
+}
+
+static void benchEngine(const char* name, StepperMotor& a, StepperMotor* b) {
+    // Host cost of a whole step, ISR and emulation included
+    a.setCurrentPosition(0);
+    a.moveToPosition(PROFILE_STEPS, MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S, MIN_VELOCITY_STEPS_S, ACCELERATION);
+    if (b) {
+        b->setCurrentPosition(0);
+        b->moveToPosition(PROFILE_STEPS, MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S, MIN_VELOCITY_STEPS_S, ACCELERATION);
+    }
+    uint64_t start = cycles();
+    stepEngine.start();
+    runEngine();
+    report(name, "host_step", (double)(cycles() - start) / (PROFILE_STEPS * (b ? 2 : 1)), CYCLE_UNIT);
+
+    // Highest constant rate the scheduling reproduces within 1% on the virtual clock, ISR compute not charged
+    double sustained = 0;
+    for (double rate = 1000; rate <= 100000; rate *= 1.1) {
+        long steps = rate / 10;
+        a.setCurrentPosition(0);
+        a.moveToPosition(steps, rate);
+        if (b) {
+            b->setCurrentPosition(0);
+            b->moveToPosition(steps, rate);
+        }
+        stepEngine.start();
+        double achieved = steps / (runEngine() / 1e9);
+        if (achieved < rate * 0.99) {
+            break;
+        }
+        sustained = rate;
+    }
+    report(name, "scheduled_step_rate", sustained, "steps/s");
+}
+
+int main() {
+    printf("benchmark,metric,value,unit\n");
+
+    TrapezoidalSpeedProfile trapezoidal;
+    RampSpeedProfile ramp;
+    TableSpeedProfile table;
+    SCurveSpeedProfile sCurve;
+    LinearSpeedProfile linear;
+    ConstantSpeedProfile constant;
+    benchProfile("TrapezoidalSpeedProfile", trapezoidal);
+    benchProfile("RampSpeedProfile", ramp);
+    benchProfile("TableSpeedProfile", table);
+    benchProfile("SCurveSpeedProfile", sCurve);
+    benchProfile("LinearSpeedProfile", linear);
+    benchProfile("ConstantSpeedProfile", constant);
+
+    benchAdvance("StepperMotor.constant", CONSTANT);
+    benchAdvance("StepperMotor.linear", LINEAR);
+    benchAdvance("StepperMotor.trapezoidal", TRAPEZOIDAL);
+
+    FastStepperMotor<STEPPER_1_STEP_PIN, STEPPER_1_DIR_PIN> coil;
+    FastStepperMotor<STEPPER_2_STEP_PIN, STEPPER_2_DIR_PIN> feeder;
+    stepEngine.addAxis(&coil);
+    stepEngine.addAxis(&feeder);
+    benchEngine("StepEngine.single", coil, nullptr);
+    benchEngine("StepEngine.dual", coil, &feeder);
+
+    return 0;
+}
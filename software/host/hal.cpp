@@ -0,0 +1,435 @@
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include <deque>
+#include <vector>
+
+/* ---------------------------------- Clock --------------------------------- */
+
+// Cost of the core calls on the board, roughly (ns)
+static const uint64_t COST_PIN_IO = 4000;
+static const uint64_t COST_TIME_READ = 2000;
+static const uint64_t COST_YIELD = 1000;
+
+static const uint8_t PIN_COUNT = 32;
+
+static uint64_t clockNs = 0;
+static bool interruptsOn = true;
+static bool inInterrupt = false;
+
+// Timer1 emulation
+volatile uint8_t TCCR1A = 0, TCCR1B = 0, TIMSK1 = 0, TIFR1 = 0;
+volatile uint16_t OCR1A = 0;
+Timer1Counter TCNT1;
+static uint64_t timer1Start = 0;     // virtual time the counter was last at zero
+static bool timer1Pending = false;   // compare match while interrupts were masked
+
+// Pin change interrupt emulation, PORTB only
+volatile uint8_t PCICR = 0, PCMSK0 = 0;
+PortInput PINB(8);
+static bool pcint0Pending = false;   // input change while interrupts were masked
+
+// Pins
+using hal::Edge;
+
+struct ScheduledInput {
+    uint64_t time;
+    uint8_t pin;
+    uint8_t level;
+};
+
+// Zero initialized, so that they are ready before any static constructor of the sketch runs
+static uint8_t pinModes[PIN_COUNT];
+static uint8_t outputLevels[PIN_COUNT];
+static uint8_t externalLevels[PIN_COUNT];   // level + 1, 0 when nothing drives the pin
+static bool recording = false;
+static std::vector<Edge> edges;
+static std::vector<ScheduledInput> scheduledInputs;
+static void (*pinChangeCallback)(uint8_t, uint8_t) = nullptr;
+
+static uint64_t timer1TickNs() {
+    switch (TCCR1B & 0x07) {
+        case 1: return 1000 / 16;
+        case 2: return 8000 / 16;
+        case 3: return 64000 / 16;
+        case 4: return 256000 / 16;
+        case 5: return 1024000 / 16;
+        default: return 0;
+    }
+}
+
+static bool timer1Running() {
+    return timer1TickNs() != 0;
+}
+
+// Virtual time of the next compare match (CTC mode, the counter restarts after OCR1A)
+static uint64_t timer1NextMatch() {
+    uint64_t tick = timer1TickNs();
+    uint64_t count = (clockNs - timer1Start) / tick;
+    if (count <= OCR1A) {
+        return timer1Start + (uint64_t)(OCR1A + 1) * tick;
+    }
+    // OCR1A moved below the counter: it has to wrap around first
+    return timer1Start + (uint64_t)(65536 + OCR1A + 1) * tick;
+}
+
+static void fireTimer1() {
+    if (!(TIMSK1 & _BV(OCIE1A)) || !timer1Running() || !TIMER1_COMPA_vect) {
+        timer1Pending = false;
+        return;
+    }
+    if (!interruptsOn || inInterrupt) {
+        timer1Pending = true;
+        return;
+    }
+    // A match during the handler sets the flag again and the handler runs once more right after
+    do {
+        timer1Pending = false;
+        inInterrupt = true;
+        interruptsOn = false;
+        TIMER1_COMPA_vect();
+        interruptsOn = true;
+        inInterrupt = false;
+    } while (timer1Pending && (TIMSK1 & _BV(OCIE1A)) && timer1Running());
+}
+
+static uint8_t pinLevel(uint8_t pin) {
+    if (externalLevels[pin]) {
+        return externalLevels[pin] - 1;
+    }
+    if (pinModes[pin] == OUTPUT) {
+        return outputLevels[pin];
+    }
+    return pinModes[pin] == INPUT_PULLUP ? HIGH : LOW;
+}
+
+static void firePcint0() {
+    if (!(PCICR & _BV(PCIE0)) || !PCINT0_vect) {
+        pcint0Pending = false;
+        return;
+    }
+    if (!interruptsOn || inInterrupt) {
+        pcint0Pending = true;
+        return;
+    }
+    pcint0Pending = false;
+    inInterrupt = true;
+    interruptsOn = false;
+    PCINT0_vect();
+    interruptsOn = true;
+    inInterrupt = false;
+}
+
+// Interrupts that were held back while masked or while another handler ran
+static void firePending() {
+    if (pcint0Pending) {
+        firePcint0();
+    }
+    if (timer1Pending) {
+        fireTimer1();
+    }
+}
+
+static void setExternalLevel(uint8_t pin, uint8_t level) {
+    uint8_t previous = pinLevel(pin);
+    externalLevels[pin] = level + 1;
+    if (pin >= 8 && pin < 14 && (PCMSK0 & _BV(pin - 8)) && pinLevel(pin) != previous) {
+        firePcint0();
+    }
+}
+
+static void applyScheduledInputs(uint64_t until) {
+    for (size_t i = 0; i < scheduledInputs.size(); ) {
+        if (scheduledInputs[i].time <= until) {
+            // Taken off the list first, the pin change ISR may get back here
+            ScheduledInput input = scheduledInputs[i];
+            scheduledInputs.erase(scheduledInputs.begin() + i);
+            setExternalLevel(input.pin, input.level);
+        } else {
+            i++;
+        }
+    }
+}
+
+namespace hal {
+
+    uint64_t nanos() {
+        return clockNs;
+    }
+
+    void advance(uint64_t ns) {
+        uint64_t target = clockNs + ns;
+        if (interruptsOn && !inInterrupt) {
+            firePending();
+        }
+        while (timer1Running()) {
+            uint64_t match = timer1NextMatch();
+            if (match > target) {
+                break;
+            }
+            clockNs = match;
+            timer1Start = match;
+            applyScheduledInputs(clockNs);
+            fireTimer1();
+            if (pcint0Pending) {
+                // An input changed during the step ISR
+                firePcint0();
+            }
+        }
+        clockNs = target;
+        applyScheduledInputs(clockNs);
+    }
+
+    bool interruptsEnabled() {
+        return interruptsOn;
+    }
+
+    void setInterrupts(bool enabled) {
+        interruptsOn = enabled;
+        if (enabled && !inInterrupt) {
+            firePending();
+        }
+    }
+
+    void setInput(uint8_t pin, uint8_t level) {
+        if (pin < PIN_COUNT) {
+            setExternalLevel(pin, level ? HIGH : LOW);
+        }
+    }
+
+    void scheduleInput(uint64_t time, uint8_t pin, uint8_t level) {
+        if (pin < PIN_COUNT) {
+            ScheduledInput input = { time, pin, (uint8_t)(level ? HIGH : LOW) };
+            scheduledInputs.push_back(input);
+        }
+    }
+
+    void onPinChange(void (*callback)(uint8_t pin, uint8_t level)) {
+        pinChangeCallback = callback;
+    }
+
+    void recordEdges(bool enabled) {
+        recording = enabled;
+    }
+
+    size_t edgeCount() {
+        return edges.size();
+    }
+
+    const Edge& edge(size_t index) {
+        return edges[index];
+    }
+
+    void clearEdges() {
+        edges.clear();
+    }
+
+    void writeEdges(FILE* file) {
+        fprintf(file, "time_ns,pin,level\n");
+        for (size_t i = 0; i < edges.size(); i++) {
+            fprintf(file, "%llu,%u,%u\n", (unsigned long long)edges[i].time, edges[i].pin, edges[i].level);
+        }
+    }
+
+}
+
+Timer1Counter::operator uint16_t() const {
+    uint64_t tick = timer1TickNs();
+    if (tick == 0) {
+        return 0;
+    }
+    return ((clockNs - timer1Start) / tick) & 0xFFFF;
+}
+
+Timer1Counter& Timer1Counter::operator=(uint16_t value) {
+    uint64_t tick = timer1TickNs();
+    timer1Start = clockNs - (tick ? value * tick : 0);
+    timer1Pending = false;
+    return *this;
+}
+
+/* ---------------------------------- Core ---------------------------------- */
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin < PIN_COUNT) {
+        pinModes[pin] = mode;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    hal::advance(COST_PIN_IO);
+    if (pin >= PIN_COUNT) {
+        return;
+    }
+    value = value ? HIGH : LOW;
+    if (outputLevels[pin] != value) {
+        outputLevels[pin] = value;
+        if (recording) {
+            Edge edge = { clockNs, pin, value };
+            edges.push_back(edge);
+        }
+        if (pinChangeCallback) {
+            pinChangeCallback(pin, value);
+        }
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    hal::advance(COST_PIN_IO);
+    if (pin >= PIN_COUNT) {
+        return LOW;
+    }
+    return pinLevel(pin);
+}
+
+PortInput::operator uint8_t() const {
+    uint8_t value = 0;
+    for (uint8_t bit = 0; bit < 6; bit++) {
+        value |= pinLevel(first + bit) << bit;
+    }
+    return value;
+}
+
+unsigned long millis() {
+    hal::advance(COST_TIME_READ);
+    return clockNs / 1000000;
+}
+
+unsigned long micros() {
+    hal::advance(COST_TIME_READ);
+    return clockNs / 1000;
+}
+
+void delay(unsigned long ms) {
+    hal::advance((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us) {
+    hal::advance((uint64_t)us * 1000);
+}
+
+void yield() {
+    hal::advance(COST_YIELD);
+}
+
+void noInterrupts() {
+    hal::setInterrupts(false);
+}
+
+void interrupts() {
+    hal::setInterrupts(true);
+}
+
+char* dtostrf(double value, signed char width, unsigned char precision, char* buffer) {
+    sprintf(buffer, "%*.*f", width, precision, value);
+    return buffer;
+}
+
+/* --------------------------------- String --------------------------------- */
+
+std::string String::format(long value, unsigned char base) {
+    if (value < 0 && base == 10) {
+        return "-" + format((unsigned long)-value, base);
+    }
+    return format((unsigned long)value, base);
+}
+
+std::string String::format(unsigned long value, unsigned char base) {
+    if (base < 2) {
+        base = 10;
+    }
+    std::string digits;
+    do {
+        uint8_t digit = value % base;
+        digits.insert(digits.begin(), digit < 10 ? '0' + digit : 'A' + digit - 10);
+        value /= base;
+    } while (value > 0);
+    return digits;
+}
+
+std::string String::format(double value, unsigned char decimals) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    return buffer;
+}
+
+/* ---------------------------------- Print --------------------------------- */
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (size--) {
+        written += write(*buffer++);
+    }
+    return written;
+}
+
+/* --------------------------------- Serial --------------------------------- */
+
+static const uint8_t SERIAL_TX_BUFFER_SIZE = 64;
+
+static uint64_t serialByteNs = 10 * 1000000000ULL / 115200;
+static uint64_t serialBusyUntil = 0;       // virtual time the last queued byte leaves the UART
+static std::deque<uint8_t> serialRx;
+static FILE* serialFile = nullptr;
+
+HardwareSerial Serial;
+
+static uint64_t serialQueued() {
+    if (serialBusyUntil <= clockNs) {
+        return 0;
+    }
+    return (serialBusyUntil - clockNs + serialByteNs - 1) / serialByteNs;
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+    serialByteNs = 10 * 1000000000ULL / baud;
+}
+
+int HardwareSerial::available() {
+    return serialRx.size();
+}
+
+int HardwareSerial::peek() {
+    return serialRx.empty() ? -1 : serialRx.front();
+}
+
+int HardwareSerial::read() {
+    if (serialRx.empty()) {
+        return -1;
+    }
+    uint8_t value = serialRx.front();
+    serialRx.pop_front();
+    return value;
+}
+
+int HardwareSerial::availableForWrite() {
+    return SERIAL_TX_BUFFER_SIZE - 1 - serialQueued();
+}
+
+void HardwareSerial::flush() {
+    if (serialBusyUntil > clockNs) {
+        hal::advance(serialBusyUntil - clockNs);
+    }
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+    // Block while the transmit buffer is full, like the AVR core does
+    while (serialQueued() >= SERIAL_TX_BUFFER_SIZE - 1) {
+        hal::advance(serialByteNs);
+    }
+    serialBusyUntil = max(serialBusyUntil, clockNs) + serialByteNs;
+    fputc(value, serialFile ? serialFile : stdout);
+    return 1;
+}
+
+namespace hal {
+
+    void serialInput(const uint8_t* data, size_t size) {
+        serialRx.insert(serialRx.end(), data, data + size);
+    }
+
+    void serialOutput(FILE* file) {
+        serialFile = file;
+    }
+
+}
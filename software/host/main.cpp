@@ -0,0 +1,110 @@
+#include <Arduino.h>
+
+// The sketch, built unchanged
+#include "CWM.ino"
+
+/**
+ * Native simulator of the coil winding machine firmware. The sketch runs on
+ * the host HAL: setup() once, then loop() until the virtual clock reaches the
+ * requested time. The feeder endstop is modeled from the feeder step and 
+ * direction pins, everything else is driven from the outside:
+ *
+ *   --until MS         virtual time to simulate (default 10000 ms)
+ *   --script FILE      input changes, one "<ms> <pin> <level>" per line
+ *   --serial-in FILE   bytes the sketch reads from Serial
+ *   --serial-out FILE  where the sketch Serial output goes (default stdout)
+ *   --edges FILE       every pin edge as CSV (time_ns,pin,level)
+ *   --lcd FILE         LCD content every time it changes ("-" for stdout)
+ *   --endstop STEPS    feeder steps from the start position to the endstop (default 2000)
+ */
+
+// Time the core takes between two passes of loop() (ns)
+static const uint64_t LOOP_OVERHEAD_NS = 1000;
+
+static long feederPosition = 0;
+static long endstopPosition = 2000;
+
+static void onPinChange(uint8_t pin, uint8_t level) {
+    if (pin != STEPPER_2_STEP_PIN || level != HIGH) {
+        return;
+    }
+    feederPosition += digitalRead(STEPPER_2_DIR_PIN) == HIGH ? 1 : -1;
+    hal::setInput(LIMIT_SWITCH_PIN, feederPosition >= endstopPosition ? LOW : HIGH);
+}
+
+static FILE* openOrDie(const char* path, const char* mode) {
+    if (strcmp(path, "-") == 0) {
+        return mode[0] == 'r' ? stdin : stdout;
+    }
+    FILE* file = fopen(path, mode);
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        exit(1);
+    }
+    return file;
+}
+
+static void loadScript(FILE* file) {
+    char line[128];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long ms;
+        unsigned int pin, level;
+        if (line[0] != '#' && sscanf(line, "%lu %u %u", &ms, &pin, &level) == 3) {
+            hal::scheduleInput((uint64_t)ms * 1000000, pin, level);
+        }
+    }
+}
+
+static void loadSerialInput(FILE* file) {
+    uint8_t buffer[256];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        hal::serialInput(buffer, size);
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned long until = 10000;
+    FILE* edgesFile = nullptr;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* option = argv[i];
+        const char* value = argv[i + 1];
+        if (strcmp(option, "--until") == 0) {
+            until = strtoul(value, nullptr, 10);
+        } else if (strcmp(option, "--script") == 0) {
+            loadScript(openOrDie(value, "r"));
+        } else if (strcmp(option, "--serial-in") == 0) {
+            loadSerialInput(openOrDie(value, "rb"));
+        } else if (strcmp(option, "--serial-out") == 0) {
+            hal::serialOutput(openOrDie(value, "wb"));
+        } else if (strcmp(option, "--edges") == 0) {
+            edgesFile = openOrDie(value, "w");
+            hal::recordEdges(true);
+        } else if (strcmp(option, "--lcd") == 0) {
+            LiquidCrystal_I2C::setTrace(openOrDie(value, "w"));
+        } else if (strcmp(option, "--endstop") == 0) {
+            endstopPosition = strtol(value, nullptr, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", option);
+            return 1;
+        }
+    }
+
+    hal::onPinChange(onPinChange);
+
+    setup();
+    lcd.traceIfChanged();
+    while (hal::nanos() < (uint64_t)until * 1000000) {
+        loop();
+        // The core checks for serial events between two passes
+        hal::advance(LOOP_OVERHEAD_NS);
+        lcd.traceIfChanged();
+    }
+
+    if (edgesFile) {
+        hal::writeEdges(edgesFile);
+        fclose(edgesFile);
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <Arduino.h>
+
+#include "telemetry.hpp"
+
+#include <vector>
+
+/**
+ * Decoder of the binary telemetry stream (see telemetry.hpp). Reads what the
+ * sketch wrote on Serial, a capture of the port or the --serial-out file of
+ * the simulator, skips whatever is not a valid frame (the text log) and 
+ * writes one CSV row per frame:
+ *
+ *   cwm_telemetry [FILE]       (stdin if missing)
+ *
+ * Frames, CRC errors and sequence gaps are counted on stderr.
+ */
+
+int main(int argc, char** argv) {
+    FILE* input = stdin;
+    if (argc > 1) {
+        input = fopen(argv[1], "rb");
+        if (input == nullptr) {
+            fprintf(stderr, "cannot open %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t size;
+    while ((size = fread(chunk, 1, sizeof(chunk), input)) > 0) {
+        data.insert(data.end(), chunk, chunk + size);
+    }
+
+    printf("seq,time_ms,coil_position,feeder_position,coil_velocity,feeder_velocity,state\n");
+
+    unsigned long frames = 0, errors = 0, missing = 0;
+    long previous = -1;
+    size_t i = 0;
+    while (i + TELEMETRY_FRAME_SIZE <= data.size()) {
+        if (data[i] != TELEMETRY_SYNC_0 || data[i + 1] != TELEMETRY_SYNC_1) {
+            i++;
+            continue;
+        }
+
+        TelemetrySample sample;
+        uint16_t sequence;
+        if (!decodeTelemetryFrame(&data[i], sample, sequence)) {
+            // Sync bytes in the text or a damaged frame, look further
+            errors++;
+            i++;
+            continue;
+        }
+
+        if (previous >= 0) {
+            missing += (uint16_t)(sequence - previous - 1);
+        }
+        previous = sequence;
+        frames++;
+
+        printf("%u,%lu,%ld,%ld,%d,%d,%u\n", sequence, (unsigned long)sample.time,
+            (long)sample.position[0], (long)sample.position[1],
+            sample.velocity[0], sample.velocity[1], sample.state);
+        i += TELEMETRY_FRAME_SIZE;
+    }
+
+    fprintf(stderr, "%lu frames, %lu CRC errors, %lu frames missing\n", frames, errors, missing);
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <stdio.h>
+
+/**
+ * Bare assertions for the host tests: a failed check is printed with its
+ * location and counted, the test goes on and main() returns checkResult().
+ */
+
+static int checkFailures = 0;
+
+#define CHECK(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            checkFailures++; \
+            printf("%s:%d: %s failed: ", __FILE__, __LINE__, #condition); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+static int checkResult() {
+    if (checkFailures > 0) {
+        printf("%d checks failed\n", checkFailures);
+        return 1;
+    }
+    return 0;
+}
+
+#endif // CHECK_HPP
@@ -0,0 +1,31 @@
+# Decode a telemetry capture of the simulator: cmake -DSIM=... -DDECODER=... -DWORK_DIR=... -P telemetry_capture.cmake
+# The capture holds the text log too, every frame must still be found, with a valid CRC and no gap.
+
+set(CAPTURE ${WORK_DIR}/telemetry_capture.bin)
+
+execute_process(COMMAND ${SIM} --until 10000 --serial-out ${CAPTURE} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "simulator failed: ${result}")
+endif()
+
+execute_process(COMMAND ${DECODER} ${CAPTURE} OUTPUT_VARIABLE csv ERROR_VARIABLE summary RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "decoder failed: ${result}")
+endif()
+
+if(NOT summary MATCHES "([0-9]+) frames, 0 CRC errors, 0 frames missing")
+    message(FATAL_ERROR "unexpected decoder summary: ${summary}")
+endif()
+set(frames ${CMAKE_MATCH_1})
+
+# One frame every TELEMETRY_PERIOD_MS (20 ms) once loop() runs, after about 2 s of homing
+if(frames LESS 300)
+    message(FATAL_ERROR "only ${frames} frames in 10 s")
+endif()
+
+string(REGEX MATCH "\n0,[0-9]+,[-0-9]+,[-0-9]+,[-0-9]+,[-0-9]+,[0-9]+\n" first "${csv}")
+if(NOT first)
+    message(FATAL_ERROR "first frame missing from the CSV")
+endif()
+
+message(STATUS "${frames} frames decoded")
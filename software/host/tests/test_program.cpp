@@ -0,0 +1,169 @@
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "stepper.hpp"
+#include "engine.hpp"
+#include "planner.hpp"
+#include "job.hpp"
+#include "program.hpp"
+#include "check.hpp"
+
+/**
+ * CoilCompiler through compileWinding: a uniform coil must add up to all
+ * its turns on the coil axis, take one segment per layer, never take the
+ * feeder past either end of the spool, and leave the feeder at home after
+ * an even number of layers and at the far end after an odd one. On pitches
+ * past the lead of the feeder screw the feeder takes more steps, the rate is
+ * its own and the coil still turns at the winding rate. ProgramJob
+ * must run it from where the coil is and from the feeder home, bringing the
+ * feeder back first when it is elsewhere, and a pause during that lead-in
+ * must not skip what is left of it when the job resumes.
+ */
+
+static FastStepperMotor<STEPPER_1_STEP_PIN, STEPPER_1_DIR_PIN> coil;
+static FastStepperMotor<STEPPER_2_STEP_PIN, STEPPER_2_DIR_PIN> feeder;
+static Planner planner(stepEngine);
+static JobRunner runner(planner, stepEngine, coil, feeder);
+
+// Serve the runner like loop() does, for at most the given time, until done() holds
+template <typename Done>
+static bool runUntil(unsigned long ms, Done done) {
+    for (unsigned long i = 0; i < ms; i++) {
+        runner.update();
+        if (done()) {
+            return true;
+        }
+        hal::advance(1000000);
+    }
+    return false;
+}
+
+static void compile(double wireDiameter, double spoolLength, double spoolDiameter, uint8_t layerCount) {
+    SegmentProgram program;
+    bool fits = compileWinding(program, wireDiameter, spoolLength, spoolDiameter, layerCount);
+    CHECK(fits, "%g mm wire, %g mm spool, %u layers: program full", wireDiameter, spoolLength, layerCount);
+    CHECK(program.size() == layerCount, "%g mm wire, %g mm spool, %u layers: %u segments",
+          wireDiameter, spoolLength, layerCount, program.size());
+
+    long coil = 0, feeder = 0;
+    long spoolSteps = lround(spoolLength * STEPS_PER_MM);
+    for (uint8_t i = 0; i < program.size(); i++) {
+        const ProgramSegment& segment = program.get(i);
+        coil += segment.steps[0];
+        feeder += segment.steps[1];
+        CHECK(segment.steps[0] > 0, "segment %u: coil steps %ld", i, segment.steps[0]);
+        CHECK(feeder <= 0 && feeder >= -spoolSteps, "segment %u: feeder at %ld, spool is %ld steps", i, feeder, spoolSteps);
+        CHECK(i == 0 || segment.rate < program.get(i - 1).rate, "segment %u: rate %u after %u",
+              i, segment.rate, program.get(i - 1).rate);
+    }
+
+    long turns = lround(layerCount * spoolLength / wireDiameter * STEPS_PER_REVOLUTION * MICROSTEPPING);
+    long travel = (layerCount % 2) ? -spoolSteps : 0;
+    CHECK(coil == turns, "%g mm wire, %u layers: %ld coil steps, expected %ld", wireDiameter, layerCount, coil, turns);
+    CHECK(feeder == travel, "%g mm wire, %u layers: feeder ends at %ld, expected %ld", wireDiameter, layerCount, feeder, travel);
+
+    // The job adds the coil to where it is, the feeder always starts from home
+    ProgramJob job(program);
+    long targetCoil, targetFeeder;
+    double velocity;
+    job.begin(123456, 0);
+    CHECK(job.size() == program.size(), "job of %u moves from home, program of %u", job.size(), program.size());
+    job.move(job.size() - 1, targetCoil, targetFeeder, velocity);
+    CHECK(targetCoil == 123456 + turns && targetFeeder == travel, "job ends at %ld/%ld, expected %ld/%ld",
+          targetCoil, targetFeeder, 123456 + turns, travel);
+    job.move(0, targetCoil, targetFeeder, velocity);
+    CHECK(targetCoil == 123456 + program.get(0).steps[0] && targetFeeder == program.get(0).steps[1],
+          "job rewound to %ld/%ld", targetCoil, targetFeeder);
+
+    // Away from home, the feeder is brought back before the program
+    job.begin(123456, travel - 400);
+    CHECK(job.size() == program.size() + 1, "job of %u moves away from home, program of %u", job.size(), program.size());
+    job.move(0, targetCoil, targetFeeder, velocity);
+    CHECK(targetCoil == 123456 && targetFeeder == 0, "lead-in to %ld/%ld", targetCoil, targetFeeder);
+    job.move(job.size() - 1, targetCoil, targetFeeder, velocity);
+    CHECK(targetCoil == 123456 + turns && targetFeeder == travel, "job ends at %ld/%ld after the lead-in", targetCoil, targetFeeder);
+}
+
+static void largePitch(double pitch, double turns) {
+    SegmentProgram program;
+    CoilCompiler compiler(program);
+    compiler.begin(40, 20);
+    bool fits = compiler.addSection(0.5, turns, pitch);
+    CHECK(fits && program.size() > 0, "%g mm pitch: %u segments", pitch, program.size());
+
+    double diameter = 20;
+    long feeder = 0;
+    for (uint8_t i = 0; i < program.size(); i++) {
+        const ProgramSegment& segment = program.get(i);
+        long coilSteps = labs(segment.steps[0]), feederSteps = labs(segment.steps[1]);
+        CHECK(feederSteps > coilSteps, "%g mm pitch, segment %u: coil leads, %ld/%ld steps", pitch, i, coilSteps, feederSteps);
+
+        // A reversal starts a layer
+        if (i > 0 && (segment.steps[1] < 0) != (program.get(i - 1).steps[1] < 0)) {
+            diameter += 2 * 0.5;
+        }
+        feeder += segment.steps[1];
+
+        double coilRate = (double)segment.rate * coilSteps / feederSteps;
+        double expected = WINDING_VELOCITY_STEPS_S * 20 / diameter;
+        if (segment.rate < MAX_VELOCITY_STEPS_S) {
+            CHECK(fabs(coilRate - expected) <= 1, "%g mm pitch, segment %u: coil at %.1f steps/s, expected %.1f",
+                  pitch, i, coilRate, expected);
+        } else {
+            CHECK(segment.rate == MAX_VELOCITY_STEPS_S && coilRate < expected, "%g mm pitch, segment %u: rate %u",
+                  pitch, i, segment.rate);
+        }
+    }
+}
+
+static void pauseDuringLeadIn() {
+    SegmentProgram program;
+    compileWinding(program, 0.5, 40, 20, 1);
+    ProgramJob job(program);
+    coil.setCurrentPosition(1000);
+    feeder.setCurrentPosition(-3000);
+    job.begin(1000, -3000);
+    runner.start(&job);
+
+    // Pause on the way home, the coil hasn't moved yet
+    bool onTheWay = runUntil(10000, []() { return feeder.getCurrentPosition() > -2900; });
+    CHECK(onTheWay, "lead-in: feeder still at %ld", feeder.getCurrentPosition());
+    runner.pause();
+    bool paused = runUntil(10000, []() { return runner.getStatus() == JobRunner::PAUSED; });
+    CHECK(paused && coil.getCurrentPosition() == 1000 && feeder.getCurrentPosition() < 0,
+          "lead-in: paused at %ld/%ld", coil.getCurrentPosition(), feeder.getCurrentPosition());
+
+    // On resume the feeder has to get home before the coil starts winding
+    runner.resume();
+    bool winding = runUntil(10000, []() { return coil.getCurrentPosition() != 1000; });
+    CHECK(winding && feeder.getCurrentPosition() == 0, "lead-in resumed: coil started with the feeder at %ld",
+          feeder.getCurrentPosition());
+
+    runner.abort();
+    runUntil(10000, []() { return runner.isOver(); });
+    runner.clear();
+}
+
+int main() {
+    stepEngine.addAxis(&coil);
+    stepEngine.addAxis(&feeder);
+    // One layer, the feeder ends at the far end
+    compile(0.5, 40, 20, 1);
+
+    // Odd and even layer counts
+    compile(0.3, 40, 20, 3);
+    compile(0.25, 25.5, 10, 2);
+    compile(0.2, 51, 16, 8);
+
+    // Thick wire, a pitch that doesn't divide the spool
+    compile(1.3, 33, 30, 5);
+
+    // Feeder leading, and so fast it has to be capped
+    largePitch(20, 10);
+    largePitch(200, 2);
+
+    // Pause and resume while the feeder is brought home
+    pauseDuringLeadIn();
+
+    return checkResult();
+}
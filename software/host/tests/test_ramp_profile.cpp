@@ -0,0 +1,47 @@
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "stepper.hpp"
+#include "check.hpp"
+
+/**
+ * RampSpeedProfile against TrapezoidalSpeedProfile: every interval of the
+ * fixed point recurrence, through the acceleration, the cruise and the
+ * deceleration, must be within 1% (plus the microsecond the interval is
+ * truncated to) of the one computed with sqrt and a division.
+ */
+
+static void compare(long steps, double initialVelocity, double maxVelocity, double finalVelocity, double acceleration) {
+    TrapezoidalSpeedProfile reference;
+    RampSpeedProfile ramp;
+    reference.compute(steps, initialVelocity, finalVelocity, maxVelocity, acceleration);
+    ramp.compute(steps, initialVelocity, finalVelocity, maxVelocity, acceleration);
+
+    int errors = 0;
+    for (long i = 1; i < steps && errors < 5; i++) {
+        double expected = 1e6 / reference.update(i);
+        double actual = ramp.interval(i);
+        if (fabs(actual - expected) > 0.01 * expected + 1) {
+            errors++;
+            CHECK(false, "%ld steps %g/%g/%g: step %ld interval %.0f us, expected %.1f us",
+                  steps, initialVelocity, maxVelocity, finalVelocity, i, actual, expected);
+        }
+    }
+}
+
+int main() {
+    // Full trapezoid, the standard move
+    compare(20000, MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S, MIN_VELOCITY_STEPS_S, ACCELERATION);
+
+    // Too short to reach the max velocity, triangle
+    compare(3000, MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S, MIN_VELOCITY_STEPS_S, ACCELERATION);
+
+    // Different entry and exit velocities, like the planner segments
+    compare(20000, MIN_VELOCITY_STEPS_S, 8000, 2000, ACCELERATION);
+    compare(8000, 3000, 6000, MIN_VELOCITY_STEPS_S, ACCELERATION);
+
+    // Slower ramp, long cruise
+    compare(50000, MIN_VELOCITY_STEPS_S, 5000, MIN_VELOCITY_STEPS_S, 2000);
+
+    return checkResult();
+}
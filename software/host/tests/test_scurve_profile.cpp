@@ -0,0 +1,89 @@
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "stepper.hpp"
+#include "check.hpp"
+
+/**
+ * SCurveSpeedProfile, run through StepperMotor the way the step engine runs
+ * it: the move must take exactly its steps, the velocity must only rise up
+ * to the peak and only fall after it (within the microsecond an interval is
+ * truncated to), and never exceed the max velocity. Moves from standstill,
+ * down to a single step, must not take their first step before the jerk
+ * allows. Only one motor at a time can run an S-curve move.
+ */
+
+static void move(long steps, double initialVelocity, double maxVelocity, double finalVelocity, double acceleration, double jerk) {
+    StepperMotor motor(STEPPER_1_STEP_PIN, STEPPER_1_DIR_PIN);
+    motor.setCurrentPosition(0);
+    bool started = motor.moveToPosition(steps, initialVelocity, maxVelocity, finalVelocity, acceleration, jerk);
+    CHECK(started, "%ld steps: S-curve move refused", steps);
+
+    // The engine waits stepInterval before each step, advance() gives the next one
+    unsigned long previous = motor.getStepInterval();
+    unsigned long first = previous;
+    unsigned long shortest = previous;
+    bool falling = false;
+    long taken = 0;
+    int errors = 0;
+    unsigned long interval;
+    do {
+        interval = motor.advance();
+        taken++;
+        if (interval == 0) {
+            break;
+        }
+        shortest = min(shortest, interval);
+
+        // Rising velocity is a shrinking interval, then it may only grow
+        if (interval > previous + 1) {
+            falling = true;
+        } else if (falling && interval + 1 < previous && errors < 5) {
+            errors++;
+            CHECK(false, "%ld steps %g/%g/%g: faster again at step %ld, %lu us after %lu us",
+                  steps, initialVelocity, maxVelocity, finalVelocity, taken, interval, previous);
+        }
+        previous = interval;
+    } while (taken <= steps);
+
+    CHECK(taken == steps && motor.getCurrentPosition() == steps, "%ld steps %g/%g/%g: took %ld steps, ended at %ld",
+          steps, initialVelocity, maxVelocity, finalVelocity, taken, motor.getCurrentPosition());
+    CHECK(shortest + 1 >= (unsigned long)(1e6 / maxVelocity), "%ld steps %g/%g/%g: %lu us interval, faster than the max velocity",
+          steps, initialVelocity, maxVelocity, finalVelocity, shortest);
+
+    // From standstill the first step can't come before the jerk allows, t1 = (6 / j)^(1/3)
+    double earliest = (initialVelocity > 0) ? 0 : cbrt(6 / jerk) * 1e6;
+    CHECK(first > 0 && first + 1 >= earliest && first < 1000000, "%ld steps %g/%g/%g: first interval %lu us, earliest %.0f us",
+          steps, initialVelocity, maxVelocity, finalVelocity, first, earliest);
+}
+
+int main() {
+    // Full S-curve, both ramps reach the max acceleration
+    move(20000, MIN_VELOCITY_STEPS_S, MAX_VELOCITY_STEPS_S, MIN_VELOCITY_STEPS_S, ACCELERATION, JERK);
+    move(20000, MIN_VELOCITY_STEPS_S, 5000, MIN_VELOCITY_STEPS_S, ACCELERATION, JERK);
+
+    // Different entry and exit velocities, too short for the max velocity
+    move(3000, 2000, MAX_VELOCITY_STEPS_S, MIN_VELOCITY_STEPS_S, ACCELERATION, JERK);
+    move(8000, MIN_VELOCITY_STEPS_S, 8000, 3000, ACCELERATION, JERK);
+
+    // From standstill, low and high jerk
+    move(20000, 0, MAX_VELOCITY_STEPS_S, 0, ACCELERATION, JERK);
+    move(20000, 0, 5000, 0, ACCELERATION, 1000000);
+
+    // Short moves from standstill, down to a single step
+    for (long steps = 1; steps <= 10; steps++) {
+        move(steps, 0, MAX_VELOCITY_STEPS_S, 0, ACCELERATION, JERK);
+    }
+    move(30, 0, MAX_VELOCITY_STEPS_S, 0, ACCELERATION, JERK);
+    move(100, 0, MAX_VELOCITY_STEPS_S, 0, ACCELERATION, JERK);
+
+    // One S-curve move at a time, the profile is shared
+    StepperMotor coil(STEPPER_1_STEP_PIN, STEPPER_1_DIR_PIN);
+    StepperMotor feeder(STEPPER_2_STEP_PIN, STEPPER_2_DIR_PIN);
+    CHECK(coil.moveToPosition(1000, 0, 5000, 0, ACCELERATION, JERK), "first S-curve move refused");
+    CHECK(!feeder.moveToPosition(1000, 0, 5000, 0, ACCELERATION, JERK), "second S-curve move accepted while the first runs");
+    while (coil.advance() != 0) {}
+    CHECK(feeder.moveToPosition(1000, 0, 5000, 0, ACCELERATION, JERK), "S-curve move refused after the first one ended");
+
+    return checkResult();
+}
@@ -0,0 +1,152 @@
+#include <Arduino.h>
+
+#include <vector>
+
+#include "config.hpp"
+#include "stepper.hpp"
+#include "engine.hpp"
+#include "check.hpp"
+
+/**
+ * StepEngine pulse timing, from the step edges the host HAL records on the
+ * virtual clock: at a constant commanded rate every step must come 1e6 / rate
+ * us after the previous one (within the microsecond the interval is truncated
+ * to and a timer tick), for a single axis and for the master of a Bresenham
+ * line. The slave of a line must take exactly its steps, each one on a
+ * master pulse, and never stray more than a step from the line.
+ */
+
+static FastStepperMotor<STEPPER_1_STEP_PIN, STEPPER_1_DIR_PIN> coil;
+static FastStepperMotor<STEPPER_2_STEP_PIN, STEPPER_2_DIR_PIN> feeder;
+
+// Run the engine until it is done, recording the edges
+static void run() {
+    hal::clearEdges();
+    hal::recordEdges(true);
+    while (stepEngine.isRunning()) {
+        hal::advance(100000);
+    }
+    hal::recordEdges(false);
+}
+
+// One pulse of the engine: the host writes the pins of a pulse one after the other
+struct Pulse {
+    uint64_t time;      // ns, first rising edge
+    bool coil, feeder;
+};
+
+static std::vector<Pulse> pulses() {
+    static const uint64_t PULSE_WINDOW = 15000;     // ns, below the shortest ISR period
+    std::vector<Pulse> result;
+    for (size_t i = 0; i < hal::edgeCount(); i++) {
+        const hal::Edge& edge = hal::edge(i);
+        if (edge.level != HIGH || (edge.pin != STEPPER_1_STEP_PIN && edge.pin != STEPPER_2_STEP_PIN)) {
+            continue;
+        }
+        if (result.empty() || edge.time - result.back().time > PULSE_WINDOW) {
+            Pulse pulse = { edge.time, false, false };
+            result.push_back(pulse);
+        }
+        (edge.pin == STEPPER_1_STEP_PIN ? result.back().coil : result.back().feeder) = true;
+    }
+    return result;
+}
+
+// Check the spacing of the pulses of an axis, return how many there were
+static long checkRate(const char* name, const std::vector<Pulse>& all, bool coilAxis, double rate) {
+    double expected = 1e6 / rate;
+    double tolerance = 1.0 + 1.0 / STEP_TIMER_TICKS_PER_US;
+    uint64_t last = 0;
+    long steps = 0;
+    int errors = 0;
+    for (size_t i = 0; i < all.size(); i++) {
+        if (!(coilAxis ? all[i].coil : all[i].feeder)) {
+            continue;
+        }
+        if (steps > 0 && errors < 5) {
+            double interval = (all[i].time - last) / 1000.0;
+            if (fabs(interval - expected) > tolerance) {
+                errors++;
+                CHECK(false, "%s at %g steps/s: step %ld after %.2f us, expected %.2f us", name, rate, steps, interval, expected);
+            }
+        }
+        last = all[i].time;
+        steps++;
+    }
+    return steps;
+}
+
+static void single(double rate, long steps) {
+    coil.setCurrentPosition(0);
+    coil.moveToPosition(steps, rate);
+    stepEngine.start();
+    run();
+
+    long taken = checkRate("single axis", pulses(), true, rate);
+    CHECK(taken == steps, "single axis at %g steps/s: %ld steps, expected %ld", rate, taken, steps);
+}
+
+static void line(double rate, long coilSteps, long feederSteps) {
+    coil.setCurrentPosition(0);
+    feeder.setCurrentPosition(0);
+
+    // A constant velocity segment, streamed like the planner does
+    StepEngine::Segment segment;
+    segment.steps[0] = coilSteps;
+    segment.steps[1] = feederSteps;
+    long masterSteps = max(labs(coilSteps), labs(feederSteps));
+    segment.profile.compute(masterSteps, rate, rate, rate, ACCELERATION);
+    segment.firstInterval = 1e6 / rate;
+    stepEngine.queue.push(segment);
+    stepEngine.startStream();
+    run();
+
+    std::vector<Pulse> all = pulses();
+    bool coilLeads = labs(coilSteps) >= labs(feederSteps);
+    long slaveSteps = coilLeads ? labs(feederSteps) : labs(coilSteps);
+
+    long taken = checkRate("line master", all, coilLeads, rate);
+    CHECK(taken == masterSteps, "line at %g steps/s: master took %ld steps, expected %ld", rate, taken, masterSteps);
+
+    // A slave step always shares a master pulse and stays on the line
+    long master = 0, slave = 0;
+    int errors = 0;
+    for (size_t i = 0; i < all.size(); i++) {
+        bool masterStep = coilLeads ? all[i].coil : all[i].feeder;
+        bool slaveStep = coilLeads ? all[i].feeder : all[i].coil;
+        master += masterStep;
+        if (!slaveStep) {
+            continue;
+        }
+        slave++;
+        double ideal = (double)master * slaveSteps / masterSteps;
+        if ((!masterStep || fabs(slave - ideal) > 1) && errors < 5) {
+            errors++;
+            CHECK(false, "line %ld/%ld: slave step %ld at master step %ld, %s", coilSteps, feederSteps,
+                  slave, master, masterStep ? "off the line" : "on a pulse of its own");
+        }
+    }
+    CHECK(slave == slaveSteps, "line %ld/%ld: slave took %ld steps, expected %ld", coilSteps, feederSteps, slave, slaveSteps);
+    CHECK(coil.getCurrentPosition() == coilSteps && feeder.getCurrentPosition() == feederSteps,
+          "line %ld/%ld: ended at %ld/%ld", coilSteps, feederSteps, coil.getCurrentPosition(), feeder.getCurrentPosition());
+}
+
+int main() {
+    stepEngine.addAxis(&coil);
+    stepEngine.addAxis(&feeder);
+
+    // Single axis, slow to the fastest winding rates, intervals not a whole number of us too
+    single(MIN_VELOCITY_STEPS_S, 500);
+    single(3000, 3000);
+    single(WINDING_VELOCITY_STEPS_S, 1000);
+    single(MAX_VELOCITY_STEPS_S, 10000);
+    single(20000, 20000);
+
+    // Bresenham lines, either axis leading, both directions
+    line(WINDING_VELOCITY_STEPS_S, 4000, -100);
+    line(5000, 12345, 6789);
+    line(MAX_VELOCITY_STEPS_S, -7000, 6999);
+    line(3000, 250, -3001);
+
+    return checkResult();
+}
@@ -0,0 +1,58 @@
+#include <Arduino.h>
+
+#include "telemetry.hpp"
+#include "check.hpp"
+
+/**
+ * Telemetry frames: known samples go through encodeTelemetryFrame() and
+ * decodeTelemetryFrame() unchanged, negative values and extremes included,
+ * and a frame with a damaged byte or CRC is refused.
+ */
+
+static void roundTrip(const TelemetrySample& sample, uint16_t sequence) {
+    uint8_t frame[TELEMETRY_FRAME_SIZE];
+    encodeTelemetryFrame(sample, sequence, frame);
+    CHECK(frame[0] == TELEMETRY_SYNC_0 && frame[1] == TELEMETRY_SYNC_1, "sync bytes %02x %02x", frame[0], frame[1]);
+
+    TelemetrySample decoded;
+    uint16_t decodedSequence;
+    CHECK(decodeTelemetryFrame(frame, decoded, decodedSequence), "frame %u refused", sequence);
+    CHECK(decodedSequence == sequence, "sequence %u, expected %u", decodedSequence, sequence);
+    CHECK(decoded.time == sample.time, "time %lu", (unsigned long)decoded.time);
+    CHECK(decoded.position[0] == sample.position[0], "coil position %ld", (long)decoded.position[0]);
+    CHECK(decoded.position[1] == sample.position[1], "feeder position %ld", (long)decoded.position[1]);
+    CHECK(decoded.velocity[0] == sample.velocity[0], "coil velocity %d", decoded.velocity[0]);
+    CHECK(decoded.velocity[1] == sample.velocity[1], "feeder velocity %d", decoded.velocity[1]);
+    CHECK(decoded.state == sample.state, "state %u", decoded.state);
+}
+
+int main() {
+    TelemetrySample sample = { 123456, { 328000, -8200 }, { 1000, -25 }, 8 };
+    roundTrip(sample, 0);
+    roundTrip(sample, 0xFFFF);
+
+    TelemetrySample extremes = { 0xFFFFFFFFUL, { -2147483647L - 1, 2147483647L }, { -32768, 32767 }, 0xFF };
+    roundTrip(extremes, 1234);
+
+    TelemetrySample zero = { 0, { 0, 0 }, { 0, 0 }, 0 };
+    roundTrip(zero, 1);
+
+    // Damaged frames are refused: CRC, payload, sync
+    uint8_t frame[TELEMETRY_FRAME_SIZE];
+    TelemetrySample decoded;
+    uint16_t sequence;
+
+    encodeTelemetryFrame(sample, 42, frame);
+    frame[TELEMETRY_FRAME_SIZE - 1] ^= 0x01;
+    CHECK(!decodeTelemetryFrame(frame, decoded, sequence), "corrupt CRC accepted");
+
+    encodeTelemetryFrame(sample, 42, frame);
+    frame[10] ^= 0x80;
+    CHECK(!decodeTelemetryFrame(frame, decoded, sequence), "corrupt position accepted");
+
+    encodeTelemetryFrame(sample, 42, frame);
+    frame[0] = 'A';
+    CHECK(!decodeTelemetryFrame(frame, decoded, sequence), "bad sync accepted");
+
+    return checkResult();
+}
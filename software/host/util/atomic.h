@@ -0,0 +1,30 @@
+#ifndef HOST_UTIL_ATOMIC_H
+#define HOST_UTIL_ATOMIC_H
+
+/**
+ * Host version of the avr-libc atomic blocks: interrupts are masked in the
+ * HAL for the duration of the block, the previous state is restored after.
+ */
+
+#include <Arduino.h>
+
+namespace hal {
+    bool interruptsEnabled();
+    void setInterrupts(bool enabled);
+
+    class AtomicGuard {
+    public:
+        AtomicGuard() : previous(interruptsEnabled()), once(true) { setInterrupts(false); }
+        ~AtomicGuard() { setInterrupts(previous); }
+        bool next() { bool result = once; once = false; return result; }
+    private:
+        bool previous, once;
+    };
+}
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 1
+
+#define ATOMIC_BLOCK(type) for (hal::AtomicGuard _atomic_guard; _atomic_guard.next(); )
+
+#endif // HOST_UTIL_ATOMIC_H